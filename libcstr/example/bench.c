@@ -0,0 +1,95 @@
+/*
+ * Static C-strings and arrays benchmarks
+ * Written 2011 by David Herrmann
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * Formatting doubles
+ * Compares cstr_append_double() to the usual way of getting the shortest
+ * round-tripping digits from the C library: print the value with 15, 16 and 17
+ * digits and parse each result with strtod() until one reads back as the
+ * value. The values are decimals with three fractional digits like the numbers
+ * of typical text formats.
+ * Usage: bench.bin [count]
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libcstr.h"
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double next_value(uint64_t *x)
+{
+	*x ^= *x << 13;
+	*x ^= *x >> 7;
+	*x ^= *x << 17;
+	return (double)(*x % 100000000) * 1e-3;
+}
+
+static size_t format_libc(char *buf, size_t size, double v)
+{
+	int precision;
+
+	for (precision = 15; precision < 17; ++precision) {
+		snprintf(buf, size, "%.*g", precision, v);
+		if (strtod(buf, NULL) == v)
+			return strlen(buf);
+	}
+
+	return snprintf(buf, size, "%.17g", v);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long i, count = 2000000;
+	uint64_t x;
+	size_t len_libc = 0, len_cstr = 0;
+	double t_libc, t_cstr;
+	char buf[32];
+	cstr *str;
+
+	if (argc > 1)
+		count = strtoul(argv[1], NULL, 10);
+
+	str = cstr_new(32);
+	if (!str)
+		return EXIT_FAILURE;
+
+	x = 88172645463325252ULL;
+	t_libc = now();
+	for (i = 0; i < count; ++i)
+		len_libc += format_libc(buf, sizeof(buf), next_value(&x));
+	t_libc = now() - t_libc;
+
+	x = 88172645463325252ULL;
+	t_cstr = now();
+	for (i = 0; i < count; ++i) {
+		str->len = 0;
+		if (!cstr_append_double(str, next_value(&x)))
+			return EXIT_FAILURE;
+		len_cstr += str->len;
+	}
+	t_cstr = now() - t_cstr;
+
+	printf("%lu doubles\n", count);
+	printf("snprintf/strtod:      %6.1f ns per value, %zu bytes\n",
+					t_libc * 1e9 / count, len_libc);
+	printf("cstr_append_double(): %6.1f ns per value, %zu bytes\n",
+					t_cstr * 1e9 / count, len_cstr);
+	printf("speedup %.2fx\n", t_libc / t_cstr);
+
+	cstr_free(str);
+	return EXIT_SUCCESS;
+}
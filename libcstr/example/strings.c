@@ -5,14 +5,30 @@
  */
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <float.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "libcstr.h"
 
+/*
+ * The library selects its vector kernels by the instruction sets of the CPU.
+ * This internal hook limits the selection to an instruction set, so the tests
+ * below run every kernel the CPU supports. The values are the ones of
+ * enum cstr__isa in the private cstr.h.
+ */
+extern void cstr__isa_limit(unsigned int isa);
+
+static const char *isa_names[] = { "scalar", "sse2", "ssse3", "avx2" };
+#define ISA_NUM (sizeof(isa_names) / sizeof(*isa_names))
+
 #define MEMFAIL2 fail(CSTR_CS("memfail"))
 #define MEMFAIL(str) ((str) ? 0 : MEMFAIL2)
 
@@ -196,12 +212,1009 @@ static void example_heap()
 	cstr_free(a);
 }
 
+/*
+ * Line reader
+ * Files in procfs report a size of zero although they are not empty. The line
+ * reader must read them instead of mapping them, so it returns as many lines
+ * as the file contains newlines.
+ */
+static void example_linereader(void)
+{
+	struct cstr_linereader reader;
+	cstr_view line;
+	size_t lines, newlines, i;
+	cstr *all;
+	int fd, r;
+
+	printf("linereader 1\n");
+	fd = open("/proc/self/status", O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		printf("no procfs, skipped\n");
+		return;
+	}
+
+	/* procfs files cannot be mapped either */
+	assert(!cstr_map_fd(fd) && errno == ENODEV);
+
+	all = cstr_read_fd(fd);
+	MEMFAIL(all);
+	assert(all->len > 0);
+	for (newlines = 0, i = 0; i < all->len; ++i)
+		newlines += all->buf[i] == '\n';
+
+	if (lseek(fd, 0, SEEK_SET) || cstr_linereader_init(&reader, fd, 0))
+		fail(CSTR_CS("linereader init"));
+	assert(!reader.map);
+
+	lines = 0;
+	while ((r = cstr_linereader_next(&reader, &line)) > 0) {
+		if (!lines)
+			assert(line.len > 5 && !memcmp(line.buf, "Name:", 5));
+		++lines;
+	}
+	assert(!r);
+	assert(lines == newlines);
+	printf("%lu lines\n", (unsigned long)lines);
+
+	cstr_linereader_destroy(&reader);
+	cstr_free(all);
+	close(fd);
+}
+
+/*
+ * UTF-8 cases
+ * Each sequence is tested with ASCII before and after it, so it starts, ends
+ * and is cut off at every position of the 16 and 32 byte vector blocks. Valid
+ * sequences encode the single code point \cp.
+ */
+struct utf8_case {
+	const char *str;
+	size_t len;
+	uint32_t cp;
+	bool valid;
+};
+
+#define UTF8_VALID(str, cp) { (str), sizeof(str) - 1, (cp), true }
+#define UTF8_INVALID(str) { (str), sizeof(str) - 1, 0, false }
+
+static const struct utf8_case utf8_cases[] = {
+	UTF8_VALID("a", 0x61),
+	UTF8_VALID("\xc2\x80", 0x80),
+	UTF8_VALID("\xc3\xa9", 0xe9),
+	UTF8_VALID("\xe0\xa0\x80", 0x800),
+	UTF8_VALID("\xe2\x82\xac", 0x20ac),
+	UTF8_VALID("\xed\x9f\xbf", 0xd7ff),
+	UTF8_VALID("\xee\x80\x80", 0xe000),
+	UTF8_VALID("\xef\xbf\xbf", 0xffff),
+	UTF8_VALID("\xf0\x90\x80\x80", 0x10000),
+	UTF8_VALID("\xf0\x9f\x98\x80", 0x1f600),
+	UTF8_VALID("\xf4\x8f\xbf\xbf", 0x10ffff),
+	/* overlong */
+	UTF8_INVALID("\xc0\x80"),
+	UTF8_INVALID("\xc1\xbf"),
+	UTF8_INVALID("\xe0\x80\x80"),
+	UTF8_INVALID("\xe0\x9f\xbf"),
+	UTF8_INVALID("\xf0\x80\x80\x80"),
+	UTF8_INVALID("\xf0\x8f\xbf\xbf"),
+	/* surrogates */
+	UTF8_INVALID("\xed\xa0\x80"),
+	UTF8_INVALID("\xed\xbf\xbf"),
+	UTF8_INVALID("\xed\xa0\xbd\xed\xb8\x80"),
+	/* above U+10FFFF */
+	UTF8_INVALID("\xf4\x90\x80\x80"),
+	UTF8_INVALID("\xf5\x80\x80\x80"),
+	UTF8_INVALID("\xf7\xbf\xbf\xbf"),
+	UTF8_INVALID("\xf8\x88\x80\x80\x80"),
+	UTF8_INVALID("\xff"),
+	/* continuation bytes without lead byte or too many of them */
+	UTF8_INVALID("\x80"),
+	UTF8_INVALID("\xbf"),
+	UTF8_INVALID("\xc3\xa9\xa9"),
+	UTF8_INVALID("\xe2\x82\xac\x80"),
+	/* truncated or interrupted sequences */
+	UTF8_INVALID("\xc3"),
+	UTF8_INVALID("\xe2\x82"),
+	UTF8_INVALID("\xe2"),
+	UTF8_INVALID("\xf0\x9f\x98"),
+	UTF8_INVALID("\xf0\x9f"),
+	UTF8_INVALID("\xc3" "a"),
+	UTF8_INVALID("\xe2\x82" "a"),
+	UTF8_INVALID("\xf0\x9f\x98" "a"),
+};
+
+static void test_utf8_case(const struct utf8_case *c, size_t pre, size_t post)
+{
+	uint8_t buf[128];
+	uint16_t u16[128];
+	uint32_t u32[128];
+	size_t len, num, i;
+	const cstr *str;
+
+	len = pre + c->len + post;
+	memset(buf, 'x', pre);
+	memcpy(&buf[pre], c->str, c->len);
+	memset(&buf[pre + c->len], 'y', post);
+	str = CSTR_CB(len, buf);
+
+	assert(cstr_utf8_valid(str) == c->valid);
+	if (!c->valid) {
+		assert(cstr_utf8_to_utf16(str, u16, len) == -EINVAL);
+		assert(cstr_utf8_to_utf32(str, u32, len) == -EINVAL);
+		return;
+	}
+
+	num = pre + 1 + post;
+	assert(cstr_utf8_len(str) == num);
+
+	assert(cstr_utf8_to_utf32(str, u32, num) == (ssize_t)num);
+	assert(cstr_utf8_to_utf32(str, u32, num - 1) == -ENOSPC);
+	for (i = 0; i < num; ++i)
+		assert(u32[i] == (i < pre ? 'x' : i > pre ? 'y' : c->cp));
+
+	/* code points above U+FFFF need a surrogate pair */
+	if (c->cp > 0xffff) {
+		assert(cstr_utf8_to_utf16(str, u16, num + 1) ==
+							(ssize_t)num + 1);
+		assert(cstr_utf8_to_utf16(str, u16, num) == -ENOSPC);
+		assert(u16[pre] == 0xd800 + ((c->cp - 0x10000) >> 10));
+		assert(u16[pre + 1] == 0xdc00 + ((c->cp - 0x10000) & 0x3ff));
+		assert(pre + 2 == num + 1 || u16[pre + 2] == 'y');
+	} else {
+		assert(cstr_utf8_to_utf16(str, u16, num) == (ssize_t)num);
+		assert(cstr_utf8_to_utf16(str, u16, num - 1) == -ENOSPC);
+		assert(u16[pre] == c->cp);
+		assert(pre + 1 == num || u16[pre + 1] == 'y');
+	}
+	assert(!pre || u16[pre - 1] == 'x');
+}
+
+static void test_utf8(void)
+{
+	static const size_t posts[] = { 0, 1, 15, 16, 33 };
+	size_t i, pre, post;
+
+	assert(cstr_utf8_valid(CSTR_CS("")));
+	assert(cstr_utf8_len(CSTR_CS("")) == 0);
+
+	for (i = 0; i < sizeof(utf8_cases) / sizeof(*utf8_cases); ++i)
+		for (pre = 0; pre <= 40; ++pre)
+			for (post = 0; post < sizeof(posts) / sizeof(*posts);
+									++post)
+				test_utf8_case(&utf8_cases[i], pre,
+								posts[post]);
+}
+
+/*
+ * Hex and base64 cases
+ * Inputs of 0 to 70 bytes cover the 12 and 16 byte blocks of the vector
+ * kernels followed by every length of the scalar tail. Encodings are compared
+ * to a byte-wise reference. The decoders must reject every corrupted input and
+ * leave the prefix "pre" of the destination as it was.
+ */
+static const char hex_chars[] = "0123456789abcdef";
+static const char b64_chars[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static size_t b64_ref(const uint8_t *s, size_t n, uint8_t *out)
+{
+	size_t i, o = 0;
+	uint32_t v;
+
+	for (i = 0; i < n; i += 3) {
+		v = s[i] << 16;
+		if (i + 1 < n)
+			v |= s[i + 1] << 8;
+		if (i + 2 < n)
+			v |= s[i + 2];
+
+		out[o++] = b64_chars[v >> 18];
+		out[o++] = b64_chars[(v >> 12) & 63];
+		out[o++] = i + 1 < n ? b64_chars[(v >> 6) & 63] : '=';
+		out[o++] = i + 2 < n ? b64_chars[v & 63] : '=';
+	}
+
+	return o;
+}
+
+static void set_prefix(cstr *dest)
+{
+	if (!cstr_cpy(dest, CSTR("pre")))
+		MEMFAIL2;
+}
+
+static void expect_prefix(const cstr *dest)
+{
+	assert(cstr_cmp(dest, CSTR_CS("pre")));
+	assert(!CSTR_CHAR(dest)[3]);
+}
+
+/* asserts that \dest is "pre" followed by the \n bytes \buf */
+static void expect_output(const cstr *dest, const void *buf, size_t n)
+{
+	assert(CSTR_LEN(dest) == 3 + n);
+	assert(!memcmp(CSTR_CHAR(dest), "pre", 3));
+	assert(!memcmp(CSTR_CHAR(dest) + 3, buf, n));
+	assert(!CSTR_CHAR(dest)[3 + n]);
+}
+
+static void test_hex(cstr *dest, const uint8_t *data, size_t n)
+{
+	static const uint8_t bad[] = {
+		'g', 'G', '/', ':', '@', '`', ' ', 0, 0x80, 0xff,
+	};
+	uint8_t enc[256], mut[256];
+	size_t i, j;
+
+	for (i = 0; i < n; ++i) {
+		enc[i * 2] = hex_chars[data[i] >> 4];
+		enc[i * 2 + 1] = hex_chars[data[i] & 15];
+	}
+
+	set_prefix(dest);
+	if (!cstr_hex_encode(dest, CSTR_CB(n, data)))
+		MEMFAIL2;
+	expect_output(dest, enc, n * 2);
+
+	set_prefix(dest);
+	assert(cstr_hex_decode(dest, CSTR_CB(n * 2, enc)) == 0);
+	expect_output(dest, data, n);
+
+	for (i = 0; i < n * 2; ++i)
+		mut[i] = enc[i] >= 'a' ? enc[i] - 'a' + 'A' : enc[i];
+	set_prefix(dest);
+	assert(cstr_hex_decode(dest, CSTR_CB(n * 2, mut)) == 0);
+	expect_output(dest, data, n);
+
+	set_prefix(dest);
+	if (n) {
+		assert(cstr_hex_decode(dest, CSTR_CB(n * 2 - 1, enc)) ==
+								-EINVAL);
+		expect_prefix(dest);
+	}
+
+	for (i = 0; i < n * 2; ++i) {
+		for (j = 0; j < sizeof(bad); ++j) {
+			memcpy(mut, enc, n * 2);
+			mut[i] = bad[j];
+			assert(cstr_hex_decode(dest, CSTR_CB(n * 2, mut)) ==
+								-EINVAL);
+			expect_prefix(dest);
+		}
+	}
+}
+
+static void test_base64(cstr *dest, const uint8_t *data, size_t n)
+{
+	static const uint8_t bad[] = {
+		'-', '_', '.', ' ', '\n', '@', '[', '`', '{', 0, 0x80, 0xff,
+	};
+	uint8_t enc[256], mut[256];
+	size_t len, i, j;
+	const char *c;
+
+	len = b64_ref(data, n, enc);
+
+	set_prefix(dest);
+	if (!cstr_base64_encode(dest, CSTR_CB(n, data)))
+		MEMFAIL2;
+	expect_output(dest, enc, len);
+
+	set_prefix(dest);
+	assert(cstr_base64_decode(dest, CSTR_CB(len, enc)) == 0);
+	expect_output(dest, data, n);
+
+	/* missing padding */
+	set_prefix(dest);
+	for (i = 1; i < 4 && i <= len; ++i) {
+		assert(cstr_base64_decode(dest, CSTR_CB(len - i, enc)) ==
+								-EINVAL);
+		expect_prefix(dest);
+	}
+
+	/* characters outside the alphabet and padding in the middle */
+	for (i = 0; i < len; ++i) {
+		for (j = 0; j <= sizeof(bad); ++j) {
+			if (j == sizeof(bad) && i >= len - 2)
+				break;
+
+			memcpy(mut, enc, len);
+			mut[i] = j < sizeof(bad) ? bad[j] : '=';
+			assert(cstr_base64_decode(dest, CSTR_CB(len, mut)) ==
+								-EINVAL);
+			expect_prefix(dest);
+		}
+	}
+
+	if (!(n % 3))
+		return;
+
+	/* padding followed by another quartet */
+	memcpy(mut, enc, len);
+	memcpy(&mut[len], "QUJD", 4);
+	assert(cstr_base64_decode(dest, CSTR_CB(len + 4, mut)) == -EINVAL);
+	expect_prefix(dest);
+
+	/* bits set in the unused part of the last character */
+	i = n % 3 == 1 ? len - 3 : len - 2;
+	for (j = 1; j < (n % 3 == 1 ? 16 : 4); ++j) {
+		memcpy(mut, enc, len);
+		c = strchr(b64_chars, enc[i]);
+		mut[i] = b64_chars[(c - b64_chars) | j];
+		assert(cstr_base64_decode(dest, CSTR_CB(len, mut)) == -EINVAL);
+		expect_prefix(dest);
+	}
+}
+
+static void test_codec(void)
+{
+	uint8_t data[70];
+	cstr *dest;
+	size_t i;
+
+	dest = cstr_new(0);
+	MEMFAIL(dest);
+
+	set_prefix(dest);
+	if (!cstr_base64_encode(dest, CSTR("foobar")))
+		MEMFAIL2;
+	assert(cstr_cmp(dest, CSTR_CS("preZm9vYmFy")));
+	set_prefix(dest);
+	assert(cstr_base64_decode(dest, CSTR("Zm9vYg==")) == 0);
+	assert(cstr_cmp(dest, CSTR_CS("prefoob")));
+
+	for (i = 0; i < sizeof(data); ++i)
+		data[i] = i * 167 + 13;
+
+	for (i = 0; i <= sizeof(data); ++i) {
+		test_hex(dest, data, i);
+		test_base64(dest, data, i);
+	}
+
+	cstr_free(dest);
+}
+
+/* runs \test with the kernels of every instruction set */
+static void for_each_isa(const char *name, void (*test)(void))
+{
+	size_t isa;
+
+	for (isa = 0; isa < ISA_NUM; ++isa) {
+		printf("%s %s\n", name, isa_names[isa]);
+		cstr__isa_limit(isa);
+		test();
+	}
+}
+
+/*
+ * Encodings
+ * UTF-8 validation and transcoding, hex and base64.
+ */
+static void example_encodings(void)
+{
+	for_each_isa("utf8", test_utf8);
+	for_each_isa("codec", test_codec);
+}
+
+/*
+ * Floating point numbers
+ * cstr_append_double() writes the shortest digits that read back as the same
+ * double. Exponent notation is used below 1e-4 and from 1e15 on, or later if
+ * more digits are needed. Some powers of two, like 2^-1017, have a shorter
+ * form than their correctly rounded 16 digits.
+ */
+struct double_case {
+	double v;
+	const char *str;
+};
+
+static const struct double_case double_cases[] = {
+	{ 0.0, "0" },
+	{ -0.0, "-0" },
+	{ 1.0, "1" },
+	{ -1.0, "-1" },
+	{ 0.1, "0.1" },
+	{ 0.1 + 0.2, "0.30000000000000004" },
+	{ 123.456, "123.456" },
+	{ 1e-4, "0.0001" },
+	{ 1.5e-5, "1.5e-05" },
+	{ 1e-7, "1e-07" },
+	{ 1e14, "100000000000000" },
+	{ 1e15, "1e+15" },
+	{ 1234567890123456.8, "1234567890123456.8" },
+	{ 9007199254740992.0, "9007199254740992" },
+	{ 1e17, "1e+17" },
+	{ 123456789012345678.0, "1.2345678901234568e+17" },
+	{ 1e21, "1e+21" },
+	{ 1e23, "1e+23" },
+	{ 1e100, "1e+100" },
+	{ 5e-324, "5e-324" },
+	{ -5e-324, "-5e-324" },
+	{ DBL_MIN, "2.2250738585072014e-308" },
+	{ DBL_MAX, "1.7976931348623157e+308" },
+	{ 0x1p-1017, "7.120236347223045e-307" },
+	{ INFINITY, "inf" },
+	{ -INFINITY, "-inf" },
+	{ NAN, "nan" },
+	{ -NAN, "-nan" },
+};
+
+/* number of significant digits of the decimal number \s */
+static int count_digits(const char *s)
+{
+	int n = 0, zeros = 0;
+
+	for (; *s && *s != 'e'; ++s) {
+		if (*s < '0' || *s > '9' || (!n && *s == '0'))
+			continue;
+		zeros = *s == '0' ? zeros + 1 : 0;
+		++n;
+	}
+
+	return n - zeros;
+}
+
+/*
+ * Appends \v to "x" and checks that it reads back as \v. Correctly rounded
+ * digits that are one shorter must not read back as \v.
+ */
+static void test_double(cstr *str, double v)
+{
+	char buf[32];
+	double back;
+	int n;
+
+	if (!cstr_cpy(str, CSTR("x")))
+		MEMFAIL2;
+	if (!cstr_append_double(str, v))
+		MEMFAIL2;
+
+	back = strtod(CSTR_CHAR(str) + 1, NULL);
+	assert(!memcmp(&back, &v, sizeof(v)));
+
+	n = count_digits(CSTR_CHAR(str) + 1);
+	assert(n <= 17);
+	if (n > 1) {
+		snprintf(buf, sizeof(buf), "%.*e", n - 2, v);
+		assert(strtod(buf, NULL) != v);
+	}
+}
+
+static void example_numbers(void)
+{
+	uint64_t e, bits, x = 88172645463325252ULL;
+	size_t i;
+	cstr *str;
+	double v;
+
+	str = cstr_new(0);
+	MEMFAIL(str);
+
+	printf("double 1\n");
+	for (i = 0; i < sizeof(double_cases) / sizeof(*double_cases); ++i) {
+		if (!cstr_cpy(str, CSTR("x")))
+			MEMFAIL2;
+		if (!cstr_append_double(str, double_cases[i].v))
+			MEMFAIL2;
+		assert(!strcmp(CSTR_CHAR(str) + 1, double_cases[i].str));
+		if (!isnan(double_cases[i].v) && !isinf(double_cases[i].v))
+			test_double(str, double_cases[i].v);
+	}
+
+	/* smallest and biggest mantissa of every exponent */
+	printf("double 2\n");
+	for (e = 0; e < 0x7ff; ++e) {
+		bits = e << 52;
+		memcpy(&v, &bits, sizeof(v));
+		test_double(str, v);
+		bits |= 1;
+		memcpy(&v, &bits, sizeof(v));
+		test_double(str, v);
+		bits |= (1ULL << 52) - 1;
+		memcpy(&v, &bits, sizeof(v));
+		test_double(str, v);
+	}
+
+	/* random finite doubles */
+	printf("double 3\n");
+	for (i = 0; i < 100000; ++i) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+		memcpy(&v, &x, sizeof(v));
+		if (!isnan(v) && !isinf(v))
+			test_double(str, v);
+	}
+
+	cstr_free(str);
+}
+
+/*
+ * Test keys
+ * Key \i is a 14 byte prefix with a zero byte in it, \i in decimal and i % 3
+ * zero bytes. All keys share more than 8 bytes and keys like "3" are prefixes
+ * of others like "30". Appending a zero byte to a key or removing the last
+ * byte of a key ending in zero never results in another key.
+ */
+#define KEY_NUM 3000
+#define KEY_VALUE(i) ((void*)(uintptr_t)((i) + 1))
+#define KEY_INDEX(value) ((size_t)(uintptr_t)(value) - 1)
+
+static const char key_prefix[] = "shared\0prefix/";
+
+static cstr *test_key(size_t i)
+{
+	uint8_t buf[64];
+	size_t len;
+	cstr *key;
+
+	len = sizeof(key_prefix) - 1;
+	memcpy(buf, key_prefix, len);
+	len += sprintf((char*)&buf[len], "%zu", i);
+	memset(&buf[len], 0, i % 3);
+	len += i % 3;
+
+	key = cstr_dup(CSTR_CB(len, buf));
+	MEMFAIL(key);
+	return key;
+}
+
+/*
+ * Hash maps
+ * Insert, lookup, erase and iteration with binary keys. Erased keys leave
+ * deleted slots behind, which must be reused or dropped by rehashing.
+ */
+static void example_map(void)
+{
+	static const char *const short_keys[] = { "", "\0", "\0\0", "a", "a\0" };
+	static const size_t short_lens[] = { 0, 1, 2, 1, 2 };
+	struct cstr_map_entry *entry;
+	struct cstr_map map;
+	cstr *keys[KEY_NUM], *key;
+	bool seen[KEY_NUM];
+	size_t i, iter, num, len, size;
+	uint8_t buf[32];
+	void *value;
+	void **v;
+
+	for (i = 0; i < KEY_NUM; ++i)
+		keys[i] = test_key(i);
+
+	printf("map 1\n");
+	cstr_map_init(&map);
+	assert(!cstr_map_find(&map, keys[0]));
+	for (i = 0; i < KEY_NUM; ++i)
+		if (!cstr_map_insert(&map, keys[i], KEY_VALUE(i)))
+			MEMFAIL2;
+	assert(cstr_map_len(&map) == KEY_NUM);
+
+	for (i = 0; i < KEY_NUM; ++i) {
+		v = cstr_map_find(&map, keys[i]);
+		assert(v && *v == KEY_VALUE(i));
+		v = cstr_map_findn(&map, keys[i]->buf, keys[i]->len);
+		assert(v && *v == KEY_VALUE(i));
+
+		memcpy(buf, keys[i]->buf, keys[i]->len);
+		buf[keys[i]->len] = 0;
+		assert(!cstr_map_findn(&map, buf, keys[i]->len + 1));
+		if (i % 3)
+			assert(!cstr_map_findn(&map, buf, keys[i]->len - 1));
+	}
+
+	/* inserting an existing key replaces the value */
+	if (!cstr_map_insert(&map, CSTR_CB(keys[5]->len, keys[5]->buf),
+								KEY_VALUE(7)))
+		MEMFAIL2;
+	assert(cstr_map_len(&map) == KEY_NUM);
+	assert(*cstr_map_find(&map, keys[5]) == KEY_VALUE(7));
+	*cstr_map_find(&map, keys[5]) = KEY_VALUE(5);
+
+	printf("map 2\n");
+	num = 0;
+	memset(seen, 0, sizeof(seen));
+	CSTR_MAP_FOR(&map, iter, entry) {
+		i = KEY_INDEX(entry->value);
+		assert(i < KEY_NUM && !seen[i]);
+		assert(cstr_cmp(entry->key, keys[i]));
+		seen[i] = true;
+		++num;
+	}
+	assert(num == KEY_NUM);
+
+	printf("map 3\n");
+	for (i = 1; i < KEY_NUM; i += 2) {
+		value = NULL;
+		assert(cstr_map_erase(&map, keys[i], &value));
+		assert(value == KEY_VALUE(i));
+		assert(!cstr_map_erase(&map, keys[i], NULL));
+	}
+	assert(cstr_map_len(&map) == KEY_NUM / 2);
+	for (i = 0; i < KEY_NUM; ++i)
+		assert(!cstr_map_find(&map, keys[i]) == (i % 2 == 1));
+
+	for (i = 1; i < KEY_NUM; i += 2)
+		if (!cstr_map_insert(&map, keys[i], KEY_VALUE(i)))
+			MEMFAIL2;
+	assert(cstr_map_len(&map) == KEY_NUM);
+	for (i = 0; i < KEY_NUM; ++i)
+		assert(*cstr_map_find(&map, keys[i]) == KEY_VALUE(i));
+
+	/*
+	 * Fill the map up to its limit and erase most keys. This leaves deleted
+	 * slots behind, which lookups must skip and rehashing must drop while
+	 * many new keys are inserted.
+	 */
+	for (num = KEY_NUM; map.growth_left; ++num) {
+		key = test_key(num);
+		if (!cstr_map_insert(&map, key, KEY_VALUE(num)))
+			MEMFAIL2;
+		cstr_free(key);
+	}
+	for (i = 0; i < num; ++i) {
+		if (!(i % 8))
+			continue;
+		key = test_key(i);
+		assert(cstr_map_erase(&map, key, NULL));
+		cstr_free(key);
+	}
+	for (i = 0; i < 100000; ++i) {
+		len = sprintf((char*)buf, "churn%zu", i);
+		if (!cstr_map_insert(&map, CSTR_CB(len, buf), KEY_VALUE(i)))
+			MEMFAIL2;
+	}
+	assert(cstr_map_len(&map) == (num + 7) / 8 + 100000);
+	for (i = 0; i < num; ++i) {
+		key = test_key(i);
+		v = cstr_map_find(&map, key);
+		assert(i % 8 ? !v : v && *v == KEY_VALUE(i));
+		if (v)
+			assert(cstr_map_erase(&map, key, NULL));
+		cstr_free(key);
+	}
+	for (i = 0; i < 100000; ++i) {
+		len = sprintf((char*)buf, "churn%zu", i);
+		v = cstr_map_findn(&map, buf, len);
+		assert(v && *v == KEY_VALUE(i));
+		assert(cstr_map_erase(&map, CSTR_CB(len, buf), NULL));
+	}
+	assert(cstr_map_len(&map) == 0);
+	CSTR_MAP_FOR(&map, iter, entry)
+		assert(0);
+
+	for (i = 0; i < sizeof(short_lens) / sizeof(*short_lens); ++i)
+		if (!cstr_map_insert(&map, CSTR_CB(short_lens[i],
+						short_keys[i]), KEY_VALUE(i)))
+			MEMFAIL2;
+	for (i = 0; i < sizeof(short_lens) / sizeof(*short_lens); ++i) {
+		v = cstr_map_findn(&map, short_keys[i], short_lens[i]);
+		assert(v && *v == KEY_VALUE(i));
+	}
+	cstr_map_destroy(&map);
+
+	/* reserved maps do not rehash */
+	printf("map 4\n");
+	cstr_map_init(&map);
+	if (!cstr_map_reserve(&map, KEY_NUM))
+		MEMFAIL2;
+	size = map.size;
+	for (i = 0; i < KEY_NUM; ++i)
+		if (!cstr_map_insert(&map, keys[i], KEY_VALUE(i)))
+			MEMFAIL2;
+	assert(map.size == size);
+	cstr_map_destroy(&map);
+
+	for (i = 0; i < KEY_NUM; ++i)
+		cstr_free(keys[i]);
+}
+
+/*
+ * Radix trees
+ * Lookups, longest prefix matches and ordered walks over the test keys, node
+ * growth from 4 to 256 children and the bulk build.
+ */
+struct trie_walk {
+	cstr *const *keys;
+	size_t *order;
+	size_t num;
+	size_t stop;
+	const cstr *prev;
+};
+
+/* records the index of \key and checks that keys are visited in order */
+static int trie_walk_fn(const cstr *key, void *value, void *data)
+{
+	struct trie_walk *w = data;
+	size_t i = KEY_INDEX(value);
+
+	assert(cstr_cmp(key, w->keys[i]));
+	assert(!w->prev || cstr_order(w->prev, key) < 0);
+	w->prev = w->keys[i];
+	if (w->order)
+		w->order[w->num] = i;
+
+	return ++w->num == w->stop ? 42 : 0;
+}
+
+static size_t trie_walk(const struct cstr_trie *trie, const cstr *prefix,
+					cstr *const *keys, size_t *order)
+{
+	struct trie_walk w = { .keys = keys, .order = order };
+
+	assert(!cstr_trie_walk(trie, prefix, trie_walk_fn, &w));
+	return w.num;
+}
+
+static void example_trie(void)
+{
+	struct cstr_trie trie, built;
+	cstr *keys[KEY_NUM], *sorted[KEY_NUM + 1], *bytes[257];
+	void *values[KEY_NUM + 1];
+	size_t order[KEY_NUM], i, j, num, len;
+	struct trie_walk w;
+	uint8_t buf[64];
+	void **v;
+
+	for (i = 0; i < KEY_NUM; ++i)
+		keys[i] = test_key(i);
+
+	printf("trie 1\n");
+	cstr_trie_init(&trie);
+	assert(!cstr_trie_find(&trie, keys[0]));
+	for (i = 0; i < KEY_NUM; ++i) {
+		j = i * 7919 % KEY_NUM;
+		if (!cstr_trie_insert(&trie, keys[j], KEY_VALUE(j)))
+			MEMFAIL2;
+	}
+	assert(cstr_trie_len(&trie) == KEY_NUM);
+
+	for (i = 0; i < KEY_NUM; ++i) {
+		v = cstr_trie_find(&trie, keys[i]);
+		assert(v && *v == KEY_VALUE(i));
+
+		len = keys[i]->len;
+		memcpy(buf, keys[i]->buf, len);
+		memcpy(&buf[len], "\0xyz", 4);
+		assert(!cstr_trie_find(&trie, CSTR_CB(len + 1, buf)));
+		if (i % 3)
+			assert(!cstr_trie_find(&trie, CSTR_CB(len - 1, buf)));
+
+		/* the key itself is the longest prefix of anything behind it */
+		v = cstr_trie_longest(&trie, CSTR_CB(len + 4, buf), &num);
+		assert(v && *v == KEY_VALUE(i) && num == len);
+	}
+	assert(!cstr_trie_longest(&trie, CSTR_CB(sizeof(key_prefix) - 1,
+						key_prefix), NULL));
+
+	/* "31\0" without its zero byte falls back to "3" */
+	v = cstr_trie_longest(&trie, CSTR_CB(keys[31]->len - 1,
+						keys[31]->buf), &num);
+	assert(v && *v == KEY_VALUE(3) && num == keys[3]->len);
+
+	if (!cstr_trie_insert(&trie, keys[5], KEY_VALUE(7)))
+		MEMFAIL2;
+	assert(cstr_trie_len(&trie) == KEY_NUM);
+	assert(*cstr_trie_find(&trie, keys[5]) == KEY_VALUE(7));
+	*cstr_trie_find(&trie, keys[5]) = KEY_VALUE(5);
+
+	printf("trie 2\n");
+	assert(trie_walk(&trie, CSTR(""), keys, order) == KEY_NUM);
+
+	/* keys with "1" after the shared prefix */
+	len = sizeof(key_prefix) - 1;
+	memcpy(buf, key_prefix, len);
+	buf[len++] = '1';
+	for (i = 0, num = 0; i < KEY_NUM; ++i)
+		num += !memcmp(keys[i]->buf, buf, len);
+	assert(trie_walk(&trie, CSTR_CB(len, buf), keys, NULL) == num);
+	assert(trie_walk(&trie, CSTR_CB(len - 2, buf), keys, NULL) ==
+								KEY_NUM);
+	assert(!trie_walk(&trie, CSTR("sharee"), keys, NULL));
+
+	w = (struct trie_walk){ .keys = keys, .stop = 5 };
+	assert(cstr_trie_walk(&trie, CSTR(""), trie_walk_fn, &w) == 42);
+	assert(w.num == 5);
+
+	/* the bulk build of the walk order with a duplicate key */
+	printf("trie 3\n");
+	for (i = 0; i < KEY_NUM; ++i) {
+		sorted[i + 1] = keys[order[i]];
+		values[i + 1] = KEY_VALUE(order[i]);
+	}
+	sorted[0] = sorted[1];
+	values[0] = NULL;
+
+	cstr_trie_init(&built);
+	if (!cstr_trie_build(&built, sorted, values, KEY_NUM + 1))
+		MEMFAIL2;
+	assert(cstr_trie_len(&built) == KEY_NUM);
+	for (i = 0; i < KEY_NUM; ++i)
+		assert(*cstr_trie_find(&built, keys[i]) == KEY_VALUE(i));
+	assert(trie_walk(&built, CSTR(""), keys, NULL) == KEY_NUM);
+	cstr_trie_destroy(&built);
+	cstr_trie_destroy(&trie);
+
+	/*
+	 * A node that grows to 256 children with a value of its own, inserted
+	 * from the highest byte down and built in one go. bytes[256] is the
+	 * key of the node itself.
+	 */
+	printf("trie 4\n");
+	bytes[256] = cstr_dup(CSTR("node"));
+	MEMFAIL(bytes[256]);
+	for (i = 0; i < 256; ++i) {
+		memcpy(buf, "node", 4);
+		buf[4] = i;
+		bytes[i] = cstr_dup(CSTR_CB(5, buf));
+		MEMFAIL(bytes[i]);
+	}
+
+	cstr_trie_init(&trie);
+	if (!cstr_trie_insert(&trie, bytes[256], KEY_VALUE(256)))
+		MEMFAIL2;
+	for (i = 256; i-- > 0; ) {
+		if (!cstr_trie_insert(&trie, bytes[i], KEY_VALUE(i)))
+			MEMFAIL2;
+		for (j = 0; j < 256; ++j) {
+			v = cstr_trie_find(&trie, bytes[j]);
+			assert(j < i ? !v : v && *v == KEY_VALUE(j));
+		}
+	}
+	assert(cstr_trie_len(&trie) == 257);
+	assert(*cstr_trie_find(&trie, bytes[256]) == KEY_VALUE(256));
+	assert(trie_walk(&trie, CSTR("node"), bytes, order) == 257);
+	assert(order[0] == 256);
+	for (i = 0; i < 256; ++i)
+		assert(order[i + 1] == i);
+
+	cstr_trie_init(&built);
+	if (!cstr_trie_build(&built, bytes, NULL, 256))
+		MEMFAIL2;
+	for (i = 0; i < 256; ++i) {
+		v = cstr_trie_find(&built, bytes[i]);
+		assert(v && !*v);
+	}
+	assert(!cstr_trie_find(&built, bytes[256]));
+	cstr_trie_destroy(&built);
+	cstr_trie_destroy(&trie);
+
+	for (i = 0; i < 257; ++i)
+		cstr_free(bytes[i]);
+	for (i = 0; i < KEY_NUM; ++i)
+		cstr_free(keys[i]);
+}
+
+/*
+ * Sorting
+ * cstr_sort() and cstr_sort_parallel() must order like qsort() with
+ * cstr_order(). The strings are the test keys, short strings of zero, 0x7f,
+ * 0x80 and 0xff bytes and strings that share their first 16 bytes, so the 8
+ * byte chunks of the sort are equal up to the third one.
+ */
+#define SORT_NUM 100000
+
+static int sort_order(const void *p1, const void *p2)
+{
+	return cstr_order(*(cstr *const*)p1, *(cstr *const*)p2);
+}
+
+static int sort_ptr(const void *p1, const void *p2)
+{
+	uintptr_t a = (uintptr_t)*(cstr *const*)p1;
+	uintptr_t b = (uintptr_t)*(cstr *const*)p2;
+
+	return (a > b) - (a < b);
+}
+
+/* asserts that \strs is \ref sorted by cstr_order() */
+static void expect_sorted(cstr **strs, cstr **ref, size_t n)
+{
+	cstr **a, **b;
+	size_t i;
+
+	for (i = 0; i < n; ++i)
+		assert(!cstr_order(strs[i], ref[i]));
+
+	/* and that it is a permutation of the input */
+	a = malloc(n * sizeof(*a) + 1);
+	b = malloc(n * sizeof(*b) + 1);
+	if (!a || !b)
+		MEMFAIL2;
+	memcpy(a, strs, n * sizeof(*a));
+	memcpy(b, ref, n * sizeof(*b));
+	qsort(a, n, sizeof(*a), sort_ptr);
+	qsort(b, n, sizeof(*b), sort_ptr);
+	assert(!memcmp(a, b, n * sizeof(*a)));
+	free(b);
+	free(a);
+}
+
+static void example_sort(void)
+{
+	static const uint8_t bytes[] = { 0, 1, 0x7f, 0x80, 0xff };
+	static const size_t sizes[] = { 0, 1, 2, 15, 16, 17, 100, 1000 };
+	static const unsigned int threads[] = { 0, 2, 3, 8 };
+	static cstr *strs[SORT_NUM], *ref[SORT_NUM], *sorted[SORT_NUM];
+	uint64_t x = 88172645463325252ULL;
+	uint8_t buf[32];
+	size_t i, j, len;
+
+	assert(cstr_order(CSTR(""), CSTR_CB(1, "\0")) < 0);
+	assert(cstr_order(CSTR_CB(1, "\0"), CSTR_CB(2, "\0\0")) < 0);
+	assert(cstr_order(CSTR_CB(2, "\0\0"), CSTR("\x01")) < 0);
+	assert(cstr_order(CSTR("\x7f"), CSTR("\x80")) < 0);
+	assert(cstr_order(CSTR_CB(2, "a\0"), CSTR("ab")) < 0);
+	assert(!cstr_order(CSTR_CB(2, "a\0"), CSTR_CB(2, "a\0")));
+
+	for (i = 0; i < SORT_NUM; ++i) {
+		x ^= x << 13;
+		x ^= x >> 7;
+		x ^= x << 17;
+
+		switch (i % 3) {
+		case 0:
+			strs[i] = test_key(x % KEY_NUM);
+			continue;
+		case 1:
+			len = x % 20;
+			break;
+		default:
+			memcpy(buf, "0123456789abcdef", 16);
+			len = 16 + x % 10;
+			break;
+		}
+
+		for (j = i % 3 == 1 ? 0 : 16; j < len; ++j)
+			buf[j] = bytes[(x >> (j * 2 + 8)) % sizeof(bytes)];
+		strs[i] = cstr_dup(CSTR_CB(len, buf));
+		MEMFAIL(strs[i]);
+	}
+
+	printf("sort 1\n");
+	for (i = 0; i < sizeof(sizes) / sizeof(*sizes); ++i) {
+		memcpy(ref, strs, sizes[i] * sizeof(*ref));
+		qsort(ref, sizes[i], sizeof(*ref), sort_order);
+		memcpy(sorted, strs, sizes[i] * sizeof(*sorted));
+		cstr_sort(sorted, sizes[i]);
+		expect_sorted(sorted, ref, sizes[i]);
+	}
+
+	printf("sort 2\n");
+	memcpy(ref, strs, sizeof(ref));
+	qsort(ref, SORT_NUM, sizeof(*ref), sort_order);
+	memcpy(sorted, strs, sizeof(sorted));
+	cstr_sort(sorted, SORT_NUM);
+	expect_sorted(sorted, ref, SORT_NUM);
+
+	for (i = 0; i < sizeof(threads) / sizeof(*threads); ++i) {
+		memcpy(sorted, strs, sizeof(sorted));
+		cstr_sort_parallel(sorted, SORT_NUM, threads[i]);
+		expect_sorted(sorted, ref, SORT_NUM);
+	}
+
+	/* already sorted input */
+	memcpy(sorted, ref, sizeof(sorted));
+	cstr_sort_parallel(sorted, SORT_NUM, 4);
+	expect_sorted(sorted, ref, SORT_NUM);
+
+	for (i = 0; i < SORT_NUM; ++i)
+		cstr_free(strs[i]);
+}
+
 int main(int argc, char **argv)
 {
 	printf("stack examples\n");
 	example_stack();
 	printf("heap examples\n");
 	example_heap();
+	printf("io examples\n");
+	example_linereader();
+	printf("encoding examples\n");
+	example_encodings();
+	printf("number examples\n");
+	example_numbers();
+	printf("container examples\n");
+	example_map();
+	example_trie();
+	example_sort();
 
 	return EXIT_SUCCESS;
 }
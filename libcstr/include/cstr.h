@@ -0,0 +1,135 @@
+/*
+ * Static C-strings and arrays
+ * Written 2011 by David Herrmann
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * Helper functions for the cstr library. This is private to libcstr and should
+ * not be installed system-wide nor used by other applications.
+ */
+
+#ifndef CSTR_CSTR_H
+#define CSTR_CSTR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "libcstr.h"
+
+/* buffers that must be copied before they are modified */
+#define CSTR_F_RDONLY (CSTR_F_SHARED | CSTR_F_MMAP)
+
+/*
+ * Allocators
+ * All allocations of the library go through these hooks, see
+ * cstr_set_allocator(). cstr__grow_size() returns the buffer size for \str
+ * when it grows to \len bytes according to its growth policy.
+ */
+extern void *(*cstr__malloc)(size_t size);
+extern void *(*cstr__realloc)(void *ptr, size_t size);
+extern void (*cstr__free)(void *ptr);
+extern size_t cstr__grow_size(const cstr *str, size_t len);
+
+/*
+ * Allocation Statistics
+ * With CSTR_STATS defined, CSTR__STAT() adds \num to the counter \field of the
+ * calling thread and cstr__stats_live() tracks process-wide live bytes, see
+ * stats.c. Without it, both expand to nothing.
+ */
+#ifdef CSTR_STATS
+
+struct cstr__stats {
+	uint64_t allocs;
+	uint64_t frees;
+	uint64_t reallocs;
+	uint64_t relocs;
+	uint64_t reloc_bytes;
+	uint64_t copyouts;
+	uint64_t copyout_bytes;
+};
+
+extern __thread struct cstr__stats *cstr__stats_local;
+extern struct cstr__stats *cstr__stats_register(void);
+extern void cstr__stats_live(int64_t diff);
+
+/* only the owning thread writes, atomics keep concurrent readers well-defined */
+#define CSTR__STAT(field, num) do { \
+		struct cstr__stats *_s = cstr__stats_local; \
+		if (__builtin_expect(!_s, 0)) \
+			_s = cstr__stats_register(); \
+		__atomic_store_n(&_s->field, __atomic_load_n(&_s->field, \
+				__ATOMIC_RELAXED) + (num), __ATOMIC_RELAXED); \
+	} while (0)
+#define CSTR__STAT_LIVE(diff) cstr__stats_live(diff)
+
+#else /* CSTR_STATS */
+
+#define CSTR__STAT(field, num) do { } while (0)
+#define CSTR__STAT_LIVE(diff) do { } while (0)
+
+#endif /* CSTR_STATS */
+
+/*
+ * Arenas
+ * Replace the buffer of the arena object \str by a buffer of at least \size + 1
+ * bytes allocated from its arena. The first \str->len bytes are preserved. The
+ * buffer is grown in place if it is the last allocation of the arena.
+ * Returns false on memory allocation failure.
+ */
+extern bool cstr__arena_grow(cstr *str, size_t size);
+
+/*
+ * Shared Buffers
+ * cstr__shared_unref() drops a reference to the shared buffer \buf and frees
+ * it when the last reference is gone. cstr__shared_dup() returns a new object
+ * which shares the buffer of \old.
+ */
+extern void cstr__shared_unref(uint8_t *buf);
+extern cstr *cstr__shared_dup(const cstr *old);
+
+/*
+ * Memory Mapped Files
+ * Unmap the buffer of \str which must have CSTR_F_MMAP set. The object itself
+ * is not modified.
+ */
+extern void cstr__mmap_release(cstr *str);
+
+/*
+ * File Descriptor I/O
+ * Waits with poll() until \fd is ready for \events. Used to retry EAGAIN on
+ * non-blocking file descriptors. Returns 0 or a negative error code.
+ */
+extern int cstr__wait_fd(int fd, short events);
+
+/*
+ * CPU Features
+ * Instruction sets that vector kernels exist for, in ascending order.
+ * cstr__isa() returns the best one this CPU supports. cstr__isa_limit() makes
+ * it return at most \isa, so every kernel can be tested on a single machine.
+ * It must not be called while other threads use the library.
+ */
+enum cstr__isa {
+	CSTR__ISA_SCALAR,
+	CSTR__ISA_SSE2,
+	CSTR__ISA_SSSE3,
+	CSTR__ISA_AVX2,
+};
+
+extern unsigned int cstr__isa(void);
+extern void cstr__isa_limit(unsigned int isa);
+
+/*
+ * Searching
+ * Vectorized search kernels on raw buffers. They return a pointer to the match
+ * or NULL. The kernels are selected at runtime on first use.
+ */
+extern const uint8_t *cstr__memchr(const uint8_t *s, size_t n, uint8_t c);
+extern const uint8_t *cstr__memrchr(const uint8_t *s, size_t n, uint8_t c);
+extern const uint8_t *cstr__memmem(const uint8_t *s, size_t n,
+					const uint8_t *needle, size_t k);
+extern const uint8_t *cstr__memchr_any(const uint8_t *s, size_t n,
+					const uint8_t *set, size_t k);
+
+#endif /* CSTR_CSTR_H */
@@ -7,17 +7,72 @@
 #ifndef CSTR_LIBCSTR_H
 #define CSTR_LIBCSTR_H
 
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/uio.h>
+
+struct cstr_arena;
 
 typedef struct cstr {
 	size_t len;
 	ssize_t size;
 	uint8_t *buf;
+	unsigned int flags;
+	struct cstr_arena *arena;
+	uint64_t hash;
 } cstr;
 
+/*
+ * Object flags
+ * These are maintained by the library and describe where the buffer of an
+ * object lives. Objects created with the CSTR_* macros below have no flags set.
+ * CSTR_F_INLINE: The buffer is stored inside the object right behind the
+ *                header. It is released together with the object.
+ * CSTR_F_ARENA: The object and its buffer are allocated from the arena
+ *               \arena. They are released when the arena is reset.
+ * CSTR_F_HASHED: \hash contains the cached result of cstr_hash(). It is
+ *                cleared whenever the string is modified by the library.
+ * CSTR_F_SHARED: The buffer is a reference counted, read-only buffer shared
+ *                with other objects. It is copied on the first modification.
+ * CSTR_F_MMAP: The buffer is a read-only memory mapping of a file. It is
+ *              copied and unmapped on the first modification or by
+ *              cstr_share().
+ *
+ * cstr_alloc() stores buffers with a size up to CSTR_INLINE_MAX inline so short
+ * strings need only a single allocation.
+ */
+
+#define CSTR_F_INLINE		0x01
+#define CSTR_F_ARENA		0x02
+#define CSTR_F_HASHED		0x04
+#define CSTR_F_SHARED		0x08
+#define CSTR_F_MMAP		0x10
+
+#define CSTR_INLINE_MAX		48
+
+/*
+ * Growth policies
+ * If a buffer grows, it is allocated bigger than required so further appends
+ * do not need to reallocate it. The growth policy selects how much bigger.
+ * CSTR_GROW_DOUBLE: Twice the required size. This is the default.
+ * CSTR_GROW_HALF: One and a half times the required size.
+ * CSTR_GROW_PAGE: The required size rounded up to full pages.
+ * CSTR_GROW_RESERVE: The required size plus a fixed reserve.
+ * These are stored in the flags of an object by cstr_set_policy(). Objects
+ * with CSTR_GROW_DEFAULT use the global policy of cstr_set_growth(). Copies of
+ * an object do not inherit its policy.
+ */
+
+#define CSTR_GROW_DEFAULT	0x000
+#define CSTR_GROW_DOUBLE	0x100
+#define CSTR_GROW_HALF		0x200
+#define CSTR_GROW_PAGE		0x300
+#define CSTR_GROW_RESERVE	0x400
+#define CSTR_GROW_MASK		0x700
+
 #define CSTR__LVALUE(arg_l, arg_s, arg_b) \
 			{ .len = arg_l, .size = arg_s, .buf = (void*)arg_b }
 
@@ -43,7 +98,7 @@ typedef struct cstr {
 #define CSTR_CONST_DYNAMIC(str) CSTR_CB(strlen(str), (str))
 
 #define CSTR_LEN(str) ((str)->len)
-#define CSTR_SIZE(str) (abs((str)->size))
+#define CSTR_SIZE(str) ((str)->size < 0 ? -(str)->size : (str)->size)
 #define CSTR_CHAR(str) ((char*)((str)->buf))
 #define CSTR_VOID(str) ((void*)((str)->buf))
 #define CSTR_UINT8(str) ((uint8_t*)((str)->buf))
@@ -59,6 +114,156 @@ extern bool cstr__cat(cstr *dest, const cstr *src, bool constant);
 extern bool cstr_cmp(const cstr *str1, const cstr *str2);
 extern bool cstr_ncmp(const cstr *str1, const cstr *str2, size_t n);
 extern bool cstr__cpy(cstr *dest, const cstr *src, bool constant);
+extern int cstr_order(const cstr *str1, const cstr *str2);
+extern void cstr_sort(cstr **strs, size_t n);
+extern void cstr_sort_parallel(cstr **strs, size_t n, unsigned int threads);
+extern ssize_t cstr_chr(const cstr *str, uint8_t c);
+extern ssize_t cstr_rchr(const cstr *str, uint8_t c);
+extern ssize_t cstr_find(const cstr *str, const cstr *needle);
+extern ssize_t cstr_find_any(const cstr *str, const cstr *set);
+
+/*
+ * Memory management
+ * cstr_set_allocator() replaces malloc(), realloc() and free() for the whole
+ * library and must be called before the first allocation.
+ * cstr_shrink_to_fit() releases unused buffer space of an object.
+ */
+
+extern void cstr_set_allocator(void *(*fn_malloc)(size_t size),
+				void *(*fn_realloc)(void *ptr, size_t size),
+				void (*fn_free)(void *ptr));
+extern void cstr_set_growth(unsigned int policy, size_t reserve);
+extern bool cstr_shrink_to_fit(cstr *str);
+
+static inline void cstr_set_policy(cstr *str, unsigned int policy)
+{
+	str->flags = (str->flags & ~CSTR_GROW_MASK) |
+						(policy & CSTR_GROW_MASK);
+}
+
+/*
+ * Allocation statistics
+ * Only collected if the library is built with CSTR_STATS (make STATS=1).
+ * Otherwise cstr_stats_get() returns false and all counters are zero.
+ * relocs counts buffers that moved while growing and reloc_bytes the bytes
+ * copied by it. copyouts counts borrowed buffers (constant, shared or mapped)
+ * that were copied into a private buffer before being modified.
+ */
+
+struct cstr_stats {
+	uint64_t allocs;
+	uint64_t frees;
+	uint64_t reallocs;
+	uint64_t relocs;
+	uint64_t reloc_bytes;
+	uint64_t copyouts;
+	uint64_t copyout_bytes;
+	uint64_t live_bytes;
+	uint64_t peak_bytes;
+};
+
+extern bool cstr_stats_get(struct cstr_stats *stats);
+
+/*
+ * Formatting
+ * These append formatted text directly to the buffer of a string without a
+ * temporary buffer. cstr_append_double() appends the shortest representation
+ * that reads back as the same value, independent of the locale.
+ */
+
+extern bool cstr_vappendf(cstr *str, const char *format, va_list args)
+					__attribute__((format(printf, 2, 0)));
+extern bool cstr_appendf(cstr *str, const char *format, ...)
+					__attribute__((format(printf, 2, 3)));
+extern bool cstr_append_u64(cstr *str, uint64_t v);
+extern bool cstr_append_i64(cstr *str, int64_t v);
+extern bool cstr_append_hex(cstr *str, uint64_t v);
+extern bool cstr_append_double(cstr *str, double v);
+
+/*
+ * UTF-8
+ * Validation and measuring of UTF-8 strings with vector kernels. The
+ * transcoding functions validate their input and return -EINVAL if it is not
+ * valid UTF-8.
+ */
+
+extern bool cstr_utf8_valid(const cstr *str);
+extern size_t cstr_utf8_len(const cstr *str);
+extern ssize_t cstr_utf8_to_utf16(const cstr *str, uint16_t *dst, size_t n);
+extern ssize_t cstr_utf8_to_utf32(const cstr *str, uint32_t *dst, size_t n);
+
+/*
+ * Hex and base64
+ * The encoders and decoders append their output to \dest. The decoders are
+ * strict and return -EINVAL on invalid input, in which case \dest is left
+ * unchanged.
+ */
+
+extern bool cstr_hex_encode(cstr *dest, const cstr *src);
+extern int cstr_hex_decode(cstr *dest, const cstr *src);
+extern bool cstr_base64_encode(cstr *dest, const cstr *src);
+extern int cstr_base64_decode(cstr *dest, const cstr *src);
+
+/*
+ * Shared buffers
+ * Objects with a shared buffer are duplicated by increasing a reference count
+ * instead of copying the string. The buffer is copied on the first
+ * modification by the library, so it must not be modified directly.
+ */
+
+extern bool cstr_share(cstr *str);
+extern cstr *cstr_sdup(const cstr *old);
+
+static inline bool cstr_unshare(cstr *str)
+	{ return cstr__fit(str, CSTR_LEN(str), true); }
+
+/*
+ * Memory mapped files
+ * A file can be used as read-only buffer without reading it into memory. The
+ * buffer is copied on the first modification by the library. Only regular
+ * files with a non-zero size can be mapped. Others fail with ENODEV, including
+ * procfs and sysfs files which report a size of zero, and must be read with
+ * cstr_read_fd() instead.
+ */
+
+extern cstr *cstr_map_fd(int fd);
+extern cstr *cstr_map_file(const cstr *path);
+
+static inline void cstr_unmap(cstr *str)
+	{ cstr_free(str); }
+
+/*
+ * File descriptor I/O
+ * cstr_writev_fd() writes many strings with a single writev() call where
+ * possible. The read functions read until end-of-file and grow the buffer as
+ * needed. All of them handle EINTR and wait for non-blocking descriptors.
+ */
+
+extern ssize_t cstr_writev_fd(int fd, cstr **strs, size_t n);
+extern int cstr_read_append_fd(cstr *str, int fd);
+extern cstr *cstr_read_fd(int fd);
+
+/*
+ * Hashing
+ * cstr_hash() caches its result in the object. cstr_chash() uses a cached hash
+ * if available but never modifies the object so it can be used on constant
+ * strings. Both use CSTR_HASH_SEED.
+ */
+
+#define CSTR_HASH_SEED 0
+
+extern uint64_t cstr_hash_seed(const cstr *str, uint64_t seed);
+extern uint64_t cstr_hash(cstr *str);
+
+static inline uint64_t cstr_chash(const cstr *str)
+{
+	if (str->flags & CSTR_F_HASHED)
+		return str->hash;
+	return cstr_hash_seed(str, CSTR_HASH_SEED);
+}
+
+static inline void cstr_hash_reset(cstr *str)
+	{ str->flags &= ~CSTR_F_HASHED; }
 
 static inline bool cstr_fit(cstr *str, size_t len)
 	{ return cstr__fit(str, len, false); }
@@ -85,4 +290,325 @@ static inline bool cstr_cpy(cstr *dest, const cstr *src)
 static inline bool cstr_ccpy(cstr *dest, const cstr *src)
 	{ return cstr__cpy(dest, src, true); }
 
+/*
+ * Single-block strings
+ * The cstr_i* family always stores the buffer inline, regardless of its size,
+ * so the object and its payload share one allocation. Resizing functions of
+ * this family take a pointer to the object pointer as they move the whole
+ * object when its inline buffer needs to grow. The regular functions can be
+ * used on these objects, too, but they move the buffer onto the heap instead.
+ */
+
+extern cstr *cstr_ialloc(size_t len, size_t size);
+extern bool cstr__ifit(cstr **str, size_t len, bool constant);
+extern cstr *cstr__idup(const cstr *old, bool constant);
+extern bool cstr__icat(cstr **dest, const cstr *src, bool constant);
+extern bool cstr__icpy(cstr **dest, const cstr *src, bool constant);
+
+static inline bool cstr_ifit(cstr **str, size_t len)
+	{ return cstr__ifit(str, len, false); }
+static inline bool cstr_cifit(cstr **str, size_t len)
+	{ return cstr__ifit(str, len, true); }
+
+static inline cstr *cstr_inew(size_t len)
+	{ return cstr_ialloc(len, len * 2); }
+static inline cstr *cstr_cinew(size_t len)
+	{ return cstr_ialloc(len, len); }
+
+static inline cstr *cstr_idup(const cstr *old)
+	{ return cstr__idup(old, false); }
+static inline cstr *cstr_cidup(const cstr *old)
+	{ return cstr__idup(old, true); }
+
+static inline bool cstr_icat(cstr **dest, const cstr *src)
+	{ return cstr__icat(dest, src, false); }
+static inline bool cstr_cicat(cstr **dest, const cstr *src)
+	{ return cstr__icat(dest, src, true); }
+
+static inline bool cstr_icpy(cstr **dest, const cstr *src)
+	{ return cstr__icpy(dest, src, false); }
+static inline bool cstr_cicpy(cstr **dest, const cstr *src)
+	{ return cstr__icpy(dest, src, true); }
+
+/*
+ * Arenas
+ * An arena allocates strings from big memory chunks and releases all of them at
+ * once. Objects allocated from an arena remember their arena so all resizing
+ * functions allocate new buffers from the same arena. If the buffer of the
+ * object that was allocated last needs to grow, it is grown in place.
+ * cstr_free() and cstr_clear() do nothing on arena objects. Instead,
+ * cstr_arena_reset() releases all objects of an arena in constant time. The
+ * chunks are kept for reuse until cstr_arena_destroy() is called.
+ * Arenas are not thread-safe.
+ */
+
+struct cstr_arena_chunk;
+
+struct cstr_arena {
+	size_t chunk_size;
+	struct cstr_arena_chunk *chunks;
+	struct cstr_arena_chunk *tail;
+	struct cstr_arena_chunk *cache;
+};
+
+#define CSTR_ARENA_CHUNK	(64 * 1024)
+
+extern void cstr_arena_init(struct cstr_arena *arena, size_t chunk_size);
+extern void cstr_arena_destroy(struct cstr_arena *arena);
+extern struct cstr_arena *cstr_arena_new(size_t chunk_size);
+extern void cstr_arena_free(struct cstr_arena *arena);
+extern void cstr_arena_reset(struct cstr_arena *arena);
+
+extern cstr *cstr_aalloc(struct cstr_arena *arena, size_t len, size_t size);
+extern cstr *cstr__adup(struct cstr_arena *arena, const cstr *old,
+								bool constant);
+
+static inline cstr *cstr_anew(struct cstr_arena *arena, size_t len)
+	{ return cstr_aalloc(arena, len, len * 2); }
+static inline cstr *cstr_canew(struct cstr_arena *arena, size_t len)
+	{ return cstr_aalloc(arena, len, len); }
+
+static inline cstr *cstr_adup(struct cstr_arena *arena, const cstr *old)
+	{ return cstr__adup(arena, old, false); }
+static inline cstr *cstr_cadup(struct cstr_arena *arena, const cstr *old)
+	{ return cstr__adup(arena, old, true); }
+
+/*
+ * Interning
+ * An intern table keeps a single immutable copy of each distinct string.
+ * Interned strings of the same table can be compared by pointer. The table is
+ * thread-safe.
+ */
+
+struct cstr_intern;
+
+extern struct cstr_intern *cstr_intern_new(void);
+extern void cstr_intern_free(struct cstr_intern *table);
+extern const cstr *cstr_intern(struct cstr_intern *table, const cstr *str);
+
+static inline bool cstr_intern_eq(const cstr *str1, const cstr *str2)
+	{ return str1 == str2; }
+
+/*
+ * Builders
+ * A builder collects string fragments and concatenates them only once when it
+ * is flattened. Borrowed fragments are not copied at all. The fragments can
+ * also be written with writev() directly.
+ */
+
+struct cstr_builder {
+	size_t len;
+	size_t num;
+	size_t size;
+	struct iovec *iov;
+	cstr *tail;
+	struct cstr_arena arena;
+};
+
+extern void cstr_builder_init(struct cstr_builder *builder);
+extern void cstr_builder_destroy(struct cstr_builder *builder);
+extern void cstr_builder_reset(struct cstr_builder *builder);
+extern bool cstr_builder_add(struct cstr_builder *builder, const cstr *str);
+extern bool cstr_builder_cat(struct cstr_builder *builder, const cstr *str);
+extern cstr *cstr__builder_flatten(const struct cstr_builder *builder,
+								bool constant);
+extern const struct iovec *cstr_builder_iov(const struct cstr_builder *builder,
+								size_t *num);
+
+static inline size_t cstr_builder_len(const struct cstr_builder *builder)
+	{ return builder->len; }
+
+static inline cstr *cstr_builder_flatten(const struct cstr_builder *builder)
+	{ return cstr__builder_flatten(builder, false); }
+static inline cstr *cstr_builder_cflatten(const struct cstr_builder *builder)
+	{ return cstr__builder_flatten(builder, true); }
+
+/*
+ * Hash maps
+ * A cstr_map maps cstr keys to arbitrary pointers. Keys are copied into the
+ * map and may contain zero characters. Lookups accept borrowed keys so they do
+ * not allocate. The map is not thread-safe.
+ */
+
+struct cstr_map_entry {
+	cstr *key;
+	void *value;
+};
+
+struct cstr_map {
+	size_t num;
+	size_t size;
+	size_t growth_left;
+	uint8_t *ctrl;
+	struct cstr_map_entry *slots;
+};
+
+extern void cstr_map_init(struct cstr_map *map);
+extern void cstr_map_destroy(struct cstr_map *map);
+extern bool cstr_map_reserve(struct cstr_map *map, size_t num);
+extern bool cstr_map_insert(struct cstr_map *map, const cstr *key,
+								void *value);
+extern void **cstr_map_find(const struct cstr_map *map, const cstr *key);
+extern void **cstr_map_findn(const struct cstr_map *map, const void *key,
+								size_t len);
+extern bool cstr_map_erase(struct cstr_map *map, const cstr *key,
+								void **value);
+extern struct cstr_map_entry *cstr_map_next(const struct cstr_map *map,
+								size_t *iter);
+
+static inline size_t cstr_map_len(const struct cstr_map *map)
+	{ return map->num; }
+
+#define CSTR_MAP_FOR(map, iter, entry) \
+	for (iter = 0; (entry = cstr_map_next((map), &iter)); )
+
+/*
+ * Radix trees
+ * A cstr_trie maps cstr keys to arbitrary pointers like a cstr_map but keeps
+ * them ordered. Besides exact lookups it finds the longest key that is a
+ * prefix of a given string and iterates over all keys with a given prefix.
+ * Keys are stored as paths in the tree and may contain zero characters. The
+ * tree is not thread-safe.
+ */
+
+struct trie_node;
+
+struct cstr_trie {
+	struct trie_node *root;
+	size_t num;
+};
+
+extern void cstr_trie_init(struct cstr_trie *trie);
+extern void cstr_trie_destroy(struct cstr_trie *trie);
+extern bool cstr_trie_insert(struct cstr_trie *trie, const cstr *key,
+								void *value);
+extern bool cstr_trie_build(struct cstr_trie *trie, cstr *const *keys,
+					void *const *values, size_t n);
+extern void **cstr_trie_find(const struct cstr_trie *trie, const cstr *key);
+extern void **cstr_trie_longest(const struct cstr_trie *trie, const cstr *key,
+							size_t *match_len);
+extern int cstr_trie_walk(const struct cstr_trie *trie, const cstr *prefix,
+		int (*fn) (const cstr *key, void *value, void *data),
+		void *data);
+
+static inline size_t cstr_trie_len(const struct cstr_trie *trie)
+	{ return trie->num; }
+
+/*
+ * Views
+ * A cstr_view references a part of a buffer without owning it. Views are never
+ * allocated and are not zero-terminated. They are only valid as long as the
+ * underlying buffer is not modified or freed. CSTR_V() creates a view of a cstr
+ * object and CSTR_VIEW() creates a temporary constant cstr object of a view.
+ * Split iterators return all fields between single delimiters, including empty
+ * ones. Tokenizers skip runs of delimiters and never return empty tokens. The
+ * delimiter set of a tokenizer must stay valid while it is used.
+ */
+
+typedef struct cstr_view {
+	const uint8_t *buf;
+	size_t len;
+} cstr_view;
+
+#define CSTR_V(str) ((cstr_view){ .buf = (str)->buf, .len = (str)->len })
+#define CSTR_VS(str) \
+	((cstr_view){ .buf = (const uint8_t*)(str), .len = sizeof(str) - 1 })
+#define CSTR_VIEW(view) CSTR_CB((view).len, (view).buf)
+
+struct cstr_split {
+	const uint8_t *pos;
+	const uint8_t *end;
+	uint8_t delim;
+	bool done;
+};
+
+struct cstr_tokenizer {
+	const uint8_t *pos;
+	const uint8_t *end;
+	const uint8_t *set;
+	size_t set_len;
+	uint64_t map[4];
+};
+
+extern cstr_view cstr_view_ltrim(cstr_view view);
+extern cstr_view cstr_view_rtrim(cstr_view view);
+extern cstr_view cstr_view_trim(cstr_view view);
+extern ssize_t cstr_view_chr(cstr_view view, uint8_t c);
+extern ssize_t cstr_view_find(cstr_view view, cstr_view needle);
+extern bool cstr_split_next(struct cstr_split *split, cstr_view *field);
+extern void cstr_tokenizer_init(struct cstr_tokenizer *tok, cstr_view view,
+								cstr_view set);
+extern bool cstr_tokenizer_next(struct cstr_tokenizer *tok, cstr_view *token);
+
+static inline cstr_view cstr_view_slice(cstr_view view, size_t start,
+								size_t end)
+{
+	if (end > view.len)
+		end = view.len;
+	if (start > end)
+		start = end;
+	return (cstr_view){ .buf = view.buf + start, .len = end - start };
+}
+
+static inline bool cstr_view_eq(cstr_view view1, cstr_view view2)
+{
+	return view1.len == view2.len &&
+				!memcmp(view1.buf, view2.buf, view1.len);
+}
+
+static inline bool cstr_view_prefix(cstr_view view, cstr_view prefix)
+{
+	return view.len >= prefix.len &&
+				!memcmp(view.buf, prefix.buf, prefix.len);
+}
+
+static inline bool cstr_view_suffix(cstr_view view, cstr_view suffix)
+{
+	return view.len >= suffix.len && !memcmp(view.buf + view.len -
+					suffix.len, suffix.buf, suffix.len);
+}
+
+static inline cstr *cstr_view_dup(cstr_view view)
+	{ return cstr_dup(CSTR_VIEW(view)); }
+static inline cstr *cstr_view_cdup(cstr_view view)
+	{ return cstr_cdup(CSTR_VIEW(view)); }
+
+static inline void cstr_split_init(struct cstr_split *split, cstr_view view,
+								uint8_t delim)
+{
+	split->pos = view.buf;
+	split->end = view.buf + view.len;
+	split->delim = delim;
+	split->done = false;
+}
+
+/*
+ * Line readers
+ * A line reader returns the lines of a file descriptor as views without
+ * copying them. Regular files with a known size are mapped, other file
+ * descriptors and procfs or sysfs files are read into a reusable buffer.
+ * Returned lines are valid until the reader is used again.
+ */
+
+#define CSTR_LINEREADER_SIZE	(256 * 1024)
+
+struct cstr_linereader {
+	int fd;
+	uint8_t *buf;
+	size_t size;
+	size_t pos;
+	size_t scan;
+	size_t end;
+	cstr *map;
+	bool eof;
+};
+
+extern int cstr_linereader_init(struct cstr_linereader *reader, int fd,
+								size_t size);
+extern void cstr_linereader_destroy(struct cstr_linereader *reader);
+extern int cstr_linereader_next(struct cstr_linereader *reader,
+							cstr_view *line);
+extern ssize_t cstr_linereader_batch(struct cstr_linereader *reader,
+						cstr_view *lines, size_t num);
+
 #endif /* CSTR_LIBCSTR_H */
@@ -0,0 +1,188 @@
+/*
+ * Static C-strings and arrays
+ * Written 2011 by David Herrmann
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * Allocators and Growth Policies
+ * All memory of the library is allocated through cstr__malloc(),
+ * cstr__realloc() and cstr__free(). They default to the allocator of the C
+ * library and can be replaced with cstr_set_allocator(). Buffers that need a
+ * special alignment (hash map control bytes and line reader buffers) are
+ * always allocated with posix_memalign() and released with free().
+ *
+ * If a buffer is grown without the \constant flag, the new size is chosen by a
+ * growth policy. The policy can be set per object with the CSTR_GROW_* flags,
+ * otherwise the global policy is used. The default is to double the size.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "cstr.h"
+#include "libcstr.h"
+
+#ifdef CSTR_STATS
+
+#include <malloc.h>
+
+static void *(*alloc_malloc)(size_t size) = malloc;
+static void *(*alloc_realloc)(void *ptr, size_t size) = realloc;
+static void (*alloc_free)(void *ptr) = free;
+static bool alloc_libc = true;
+
+/* sizes are only known for buffers of the C library allocator */
+static inline int64_t stats_size(void *ptr)
+{
+	return alloc_libc ? (int64_t)malloc_usable_size(ptr) : 0;
+}
+
+static void *stats_malloc(size_t size)
+{
+	void *ptr;
+
+	ptr = alloc_malloc(size);
+	if (ptr) {
+		CSTR__STAT(allocs, 1);
+		CSTR__STAT_LIVE(stats_size(ptr));
+	}
+
+	return ptr;
+}
+
+static void *stats_realloc(void *ptr, size_t size)
+{
+	int64_t old;
+	void *snew;
+
+	old = ptr ? stats_size(ptr) : 0;
+	snew = alloc_realloc(ptr, size);
+	if (snew) {
+		CSTR__STAT(reallocs, 1);
+		CSTR__STAT_LIVE(stats_size(snew) - old);
+	}
+
+	return snew;
+}
+
+static void stats_free(void *ptr)
+{
+	if (ptr) {
+		CSTR__STAT(frees, 1);
+		CSTR__STAT_LIVE(-stats_size(ptr));
+	}
+
+	alloc_free(ptr);
+}
+
+void *(*cstr__malloc)(size_t size) = stats_malloc;
+void *(*cstr__realloc)(void *ptr, size_t size) = stats_realloc;
+void (*cstr__free)(void *ptr) = stats_free;
+
+#else /* CSTR_STATS */
+
+void *(*cstr__malloc)(size_t size) = malloc;
+void *(*cstr__realloc)(void *ptr, size_t size) = realloc;
+void (*cstr__free)(void *ptr) = free;
+
+#endif /* CSTR_STATS */
+
+static unsigned int grow_policy = CSTR_GROW_DOUBLE;
+static size_t grow_reserve = 0;
+
+/*
+ * Set allocator
+ * Replaces the allocator of the library. This must be called before any
+ * object is allocated as memory must be released by the allocator it was
+ * allocated with. Passing NULL for all three functions restores the allocator
+ * of the C library.
+ * This is not thread-safe.
+ */
+void cstr_set_allocator(void *(*fn_malloc)(size_t size),
+			void *(*fn_realloc)(void *ptr, size_t size),
+			void (*fn_free)(void *ptr))
+{
+#ifdef CSTR_STATS
+	alloc_malloc = fn_malloc ? fn_malloc : malloc;
+	alloc_realloc = fn_realloc ? fn_realloc : realloc;
+	alloc_free = fn_free ? fn_free : free;
+	alloc_libc = alloc_malloc == malloc && alloc_realloc == realloc &&
+							alloc_free == free;
+#else
+	cstr__malloc = fn_malloc ? fn_malloc : malloc;
+	cstr__realloc = fn_realloc ? fn_realloc : realloc;
+	cstr__free = fn_free ? fn_free : free;
+#endif
+}
+
+/*
+ * Set growth policy
+ * Sets the global growth policy which is used for all objects without a
+ * policy of their own. \policy is one of the CSTR_GROW_* values except for
+ * CSTR_GROW_DEFAULT. \reserve is the number of extra bytes reserved with
+ * CSTR_GROW_RESERVE.
+ * This is not thread-safe.
+ */
+void cstr_set_growth(unsigned int policy, size_t reserve)
+{
+	policy &= CSTR_GROW_MASK;
+	if (policy == CSTR_GROW_DEFAULT)
+		policy = CSTR_GROW_DOUBLE;
+
+	grow_policy = policy;
+	grow_reserve = reserve;
+}
+
+size_t cstr__grow_size(const cstr *str, size_t len)
+{
+	unsigned int policy;
+	size_t page;
+
+	policy = str->flags & CSTR_GROW_MASK;
+	if (policy == CSTR_GROW_DEFAULT)
+		policy = grow_policy;
+
+	switch (policy) {
+	case CSTR_GROW_HALF:
+		return len + len / 2;
+	case CSTR_GROW_PAGE:
+		/* the allocation includes the terminating zero */
+		page = sysconf(_SC_PAGESIZE);
+		return ((len + page) & ~(page - 1)) - 1;
+	case CSTR_GROW_RESERVE:
+		return len + grow_reserve;
+	case CSTR_GROW_DOUBLE:
+	default:
+		return len * 2;
+	}
+}
+
+/*
+ * Shrink buffer
+ * Reallocates the buffer of \str so it is exactly as big as the string. This
+ * is useful for long-lived strings that were built by appending. Inline,
+ * arena and borrowed buffers are left untouched.
+ * Returns false on memory allocation failure, \str is unchanged then.
+ */
+bool cstr_shrink_to_fit(cstr *str)
+{
+	uint8_t *snew;
+
+	if (str->size < 0 || (str->flags & (CSTR_F_INLINE | CSTR_F_ARENA)))
+		return true;
+	if (str->flags & CSTR_F_RDONLY)
+		return true;
+	if ((size_t)str->size == str->len)
+		return true;
+
+	snew = cstr__realloc(str->buf, str->len + 1);
+	if (!snew)
+		return false;
+
+	str->buf = snew;
+	str->size = str->len;
+
+	return true;
+}
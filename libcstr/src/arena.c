@@ -0,0 +1,241 @@
+/*
+ * Static C-strings and arrays
+ * Written 2011 by David Herrmann
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * Arenas
+ * An arena is a list of big memory chunks. Allocations are served from the
+ * current chunk by bumping its position. If the chunk is full, a new chunk is
+ * taken from the cache or allocated with cstr__malloc() and becomes the current
+ * chunk. Allocations bigger than the chunk size get a chunk of their own.
+ * \chunks is the list of chunks in use, starting with the current chunk, and
+ * \tail is the last entry of this list. Resetting the arena simply moves the
+ * whole list into \cache so this is O(1). Cached chunks are rewound when they
+ * are reused.
+ * Objects are allocated together with their initial buffer. The buffer follows
+ * the header directly so it is the last allocation of the chunk until the next
+ * object is allocated, which allows to grow it in place.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cstr.h"
+#include "libcstr.h"
+
+#define ARENA_ALIGN 16
+
+struct cstr_arena_chunk {
+	struct cstr_arena_chunk *next;
+	size_t size;
+	size_t pos;
+	uint8_t data[] __attribute__((aligned(ARENA_ALIGN)));
+};
+
+static inline size_t align(size_t pos)
+{
+	return (pos + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+void cstr_arena_init(struct cstr_arena *arena, size_t chunk_size)
+{
+	if (!chunk_size)
+		chunk_size = CSTR_ARENA_CHUNK;
+
+	arena->chunk_size = chunk_size;
+	arena->chunks = NULL;
+	arena->tail = NULL;
+	arena->cache = NULL;
+}
+
+void cstr_arena_destroy(struct cstr_arena *arena)
+{
+	struct cstr_arena_chunk *t;
+
+	cstr_arena_reset(arena);
+
+	while (arena->cache) {
+		t = arena->cache;
+		arena->cache = t->next;
+		cstr__free(t);
+	}
+}
+
+struct cstr_arena *cstr_arena_new(size_t chunk_size)
+{
+	struct cstr_arena *arena;
+
+	arena = cstr__malloc(sizeof(*arena));
+	if (!arena)
+		return NULL;
+
+	cstr_arena_init(arena, chunk_size);
+	return arena;
+}
+
+void cstr_arena_free(struct cstr_arena *arena)
+{
+	if (arena) {
+		cstr_arena_destroy(arena);
+		cstr__free(arena);
+	}
+}
+
+/*
+ * Release all objects of \arena
+ * All objects allocated from \arena are invalid after this call. The chunks
+ * are kept in the cache for later allocations.
+ */
+void cstr_arena_reset(struct cstr_arena *arena)
+{
+	if (arena->chunks) {
+		arena->tail->next = arena->cache;
+		arena->cache = arena->chunks;
+		arena->chunks = NULL;
+		arena->tail = NULL;
+	}
+}
+
+/*
+ * Make a chunk with at least \size free bytes the current chunk. Cached chunks
+ * that are too small for the request are released.
+ * Returns NULL on memory allocation failure.
+ */
+static struct cstr_arena_chunk *arena_add(struct cstr_arena *arena,
+								size_t size)
+{
+	struct cstr_arena_chunk *chunk;
+
+	while ((chunk = arena->cache)) {
+		arena->cache = chunk->next;
+		if (chunk->size >= size)
+			break;
+		cstr__free(chunk);
+	}
+
+	if (!chunk) {
+		if (size < arena->chunk_size)
+			size = arena->chunk_size;
+
+		chunk = cstr__malloc(sizeof(*chunk) + size);
+		if (!chunk)
+			return NULL;
+		chunk->size = size;
+	}
+
+	chunk->pos = 0;
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+	if (!arena->tail)
+		arena->tail = chunk;
+
+	return chunk;
+}
+
+/*
+ * Allocate \size bytes from \arena. The returned memory is aligned to
+ * ARENA_ALIGN bytes.
+ * Returns NULL on memory allocation failure.
+ */
+static void *arena_get(struct cstr_arena *arena, size_t size)
+{
+	struct cstr_arena_chunk *chunk;
+	size_t pos;
+
+	chunk = arena->chunks;
+	if (chunk) {
+		pos = align(chunk->pos);
+		if (pos <= chunk->size && chunk->size - pos >= size) {
+			chunk->pos = pos + size;
+			return &chunk->data[pos];
+		}
+	}
+
+	chunk = arena_add(arena, size);
+	if (!chunk)
+		return NULL;
+
+	chunk->pos = size;
+	return chunk->data;
+}
+
+/*
+ * Allocate new string from arena
+ * This works like cstr_alloc() with a NULL buffer but allocates the object and
+ * its buffer from \arena. The object must not be used after the arena is reset
+ * or destroyed.
+ * Returns NULL on memory allocation errors.
+ */
+cstr *cstr_aalloc(struct cstr_arena *arena, size_t len, size_t size)
+{
+	cstr *str;
+
+	assert(arena);
+	assert(len <= size);
+
+	str = arena_get(arena, sizeof(*str) + size + 1);
+	if (!str)
+		return NULL;
+
+	str->len = len;
+	str->size = size;
+	str->buf = (uint8_t*)(str + 1);
+	str->flags = CSTR_F_ARENA;
+	str->arena = arena;
+	str->buf[len] = 0;
+
+	return str;
+}
+
+/*
+ * Duplicate string into arena
+ * Like cstr__dup() but the new object is allocated from \arena.
+ */
+cstr *cstr__adup(struct cstr_arena *arena, const cstr *old, bool constant)
+{
+	cstr *dest;
+
+	assert(old);
+
+	if (constant)
+		dest = cstr_canew(arena, CSTR_LEN(old));
+	else
+		dest = cstr_anew(arena, CSTR_LEN(old));
+	if (!dest)
+		return NULL;
+
+	memcpy(CSTR_VOID(dest), CSTR_VOID(old), CSTR_LEN(old));
+	return dest;
+}
+
+bool cstr__arena_grow(cstr *str, size_t size)
+{
+	struct cstr_arena_chunk *chunk = str->arena->chunks;
+	uint8_t *snew;
+
+	assert(str->flags & CSTR_F_ARENA);
+	assert(str->size >= 0 && size > (size_t)str->size);
+
+	/* grow in place if our buffer is the last allocation of the arena */
+	if (chunk && str->buf + str->size + 1 == &chunk->data[chunk->pos] &&
+			chunk->size - chunk->pos >= size - str->size) {
+		chunk->pos += size - str->size;
+		str->size = size;
+		return true;
+	}
+
+	snew = arena_get(str->arena, size + 1);
+	if (!snew)
+		return false;
+
+	memcpy(snew, str->buf, str->len);
+	str->buf = snew;
+	str->size = size;
+
+	return true;
+}
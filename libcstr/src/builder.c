@@ -0,0 +1,185 @@
+/*
+ * Static C-strings and arrays
+ * Written 2011 by David Herrmann
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * String Builder
+ * A builder collects string fragments in an iovec array instead of copying
+ * them into a single buffer. Borrowed fragments are referenced directly.
+ * Fragments that must be copied are stored in the builder's arena. Consecutive
+ * copies are appended to the same arena object which is grown in place, so
+ * they end up in a single fragment.
+ * The fragments are either flattened with a single copy into a new cstr object
+ * or passed to writev() without any copy at all.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include "cstr.h"
+#include "libcstr.h"
+
+#define BUILDER_MIN 16
+
+void cstr_builder_init(struct cstr_builder *builder)
+{
+	builder->len = 0;
+	builder->num = 0;
+	builder->size = 0;
+	builder->iov = NULL;
+	builder->tail = NULL;
+	cstr_arena_init(&builder->arena, 0);
+}
+
+void cstr_builder_destroy(struct cstr_builder *builder)
+{
+	cstr__free(builder->iov);
+	cstr_arena_destroy(&builder->arena);
+	builder->len = 0;
+	builder->num = 0;
+	builder->size = 0;
+	builder->iov = NULL;
+	builder->tail = NULL;
+}
+
+/*
+ * Drop all fragments
+ * The builder can be reused afterwards. Allocated memory is kept for reuse.
+ */
+void cstr_builder_reset(struct cstr_builder *builder)
+{
+	builder->len = 0;
+	builder->num = 0;
+	builder->tail = NULL;
+	cstr_arena_reset(&builder->arena);
+}
+
+/* make room for one more fragment; returns false on allocation failure */
+static bool builder_grow(struct cstr_builder *builder)
+{
+	struct iovec *iov;
+	size_t size;
+
+	if (builder->num < builder->size)
+		return true;
+
+	size = builder->size ? builder->size * 2 : BUILDER_MIN;
+	iov = cstr__realloc(builder->iov, size * sizeof(*iov));
+	if (!iov)
+		return false;
+
+	builder->iov = iov;
+	builder->size = size;
+	return true;
+}
+
+/*
+ * Add borrowed fragment
+ * This appends \str to \builder without copying it. The buffer of \str must
+ * stay valid and unmodified until the builder is flattened or reset. This is
+ * usually used with CSTR_B() or CSTR_CB() objects.
+ * Returns false on memory allocation failure.
+ */
+bool cstr_builder_add(struct cstr_builder *builder, const cstr *str)
+{
+	if (!CSTR_LEN(str))
+		return true;
+
+	if (!builder_grow(builder))
+		return false;
+
+	builder->iov[builder->num].iov_base = CSTR_VOID(str);
+	builder->iov[builder->num].iov_len = CSTR_LEN(str);
+	++builder->num;
+	builder->len += CSTR_LEN(str);
+	builder->tail = NULL;
+
+	return true;
+}
+
+/*
+ * Add copied fragment
+ * This appends a copy of \str to \builder so \str may be modified or freed
+ * afterwards. Consecutive copies are merged into a single fragment.
+ * Returns false on memory allocation failure.
+ */
+bool cstr_builder_cat(struct cstr_builder *builder, const cstr *str)
+{
+	struct iovec *iov;
+
+	if (!CSTR_LEN(str))
+		return true;
+
+	if (builder->tail) {
+		if (!cstr_cat(builder->tail, str))
+			return false;
+
+		iov = &builder->iov[builder->num - 1];
+		iov->iov_base = CSTR_VOID(builder->tail);
+		iov->iov_len = CSTR_LEN(builder->tail);
+		builder->len += CSTR_LEN(str);
+		return true;
+	}
+
+	if (!builder_grow(builder))
+		return false;
+
+	builder->tail = cstr_adup(&builder->arena, str);
+	if (!builder->tail)
+		return false;
+
+	builder->iov[builder->num].iov_base = CSTR_VOID(builder->tail);
+	builder->iov[builder->num].iov_len = CSTR_LEN(builder->tail);
+	++builder->num;
+	builder->len += CSTR_LEN(str);
+
+	return true;
+}
+
+/*
+ * Flatten builder
+ * This copies all fragments of \builder into a new cstr object. \constant
+ * controls how the buffer is allocated, see cstr__dup(). The builder is not
+ * modified.
+ * Returns NULL on memory allocation failure.
+ */
+cstr *cstr__builder_flatten(const struct cstr_builder *builder, bool constant)
+{
+	cstr *str;
+	uint8_t *pos;
+	size_t i;
+
+	if (constant)
+		str = cstr_cnew(builder->len);
+	else
+		str = cstr_new(builder->len);
+	if (!str)
+		return NULL;
+
+	pos = CSTR_UINT8(str);
+	for (i = 0; i < builder->num; ++i) {
+		memcpy(pos, builder->iov[i].iov_base, builder->iov[i].iov_len);
+		pos += builder->iov[i].iov_len;
+	}
+
+	return str;
+}
+
+/*
+ * Get fragments
+ * This returns the fragments of \builder as iovec array which can be passed to
+ * writev(). The number of entries is stored in \num. The array is valid until
+ * the builder is modified, reset or destroyed. The buffers must not be written
+ * to. Note that writev() does not accept more than IOV_MAX entries at once.
+ */
+const struct iovec *cstr_builder_iov(const struct cstr_builder *builder,
+								size_t *num)
+{
+	*num = builder->num;
+	return builder->iov;
+}
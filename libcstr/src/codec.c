@@ -0,0 +1,487 @@
+/*
+ * Static C-strings and arrays
+ * Written 2011 by David Herrmann
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * Hex and Base64
+ * The encoders and decoders append to the destination string. Its buffer is
+ * resized once with cstr__fit() and the output is written directly into it.
+ * Decoding is strict: hex input must have an even length and base64 input
+ * must use the standard alphabet with padding, contain no whitespace and have
+ * no bits set in the unused part of the last character. On errors the
+ * destination is reset to its previous length.
+ *
+ * The SSSE3 kernels classify 16 characters at once. Hex characters are
+ * converted with range checks and pairs are merged with pmaddubsw. Base64
+ * follows the approach of Mula and Lemire: encoding shuffles 12 input bytes
+ * into 16 lanes, splits them into 6 bit indices with multiplies and maps the
+ * indices to ASCII with a pshufb offset table. Decoding validates each
+ * character with a bitmask table indexed by its nibbles and packs the 6 bit
+ * values with pmaddubsw and pmaddwd.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cstr.h"
+#include "libcstr.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+	#define CODEC_SIMD 1
+	#include <immintrin.h>
+#endif
+
+struct codec_ops {
+	void (*hex_enc) (const uint8_t *s, size_t n, uint8_t *out);
+	bool (*hex_dec) (const uint8_t *s, size_t n, uint8_t *out);
+	void (*b64_enc) (const uint8_t *s, size_t n, uint8_t *out);
+	bool (*b64_dec) (const uint8_t *s, size_t n, uint8_t *out);
+};
+
+static const char hex_chars[] = "0123456789abcdef";
+static const char b64_chars[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* returns the value of a hex or base64 character or -1 if it is invalid */
+static inline int hex_value(uint8_t c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	c |= 0x20;
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+static inline int b64_value(uint8_t c)
+{
+	if (c >= 'A' && c <= 'Z')
+		return c - 'A';
+	if (c >= 'a' && c <= 'z')
+		return c - 'a' + 26;
+	if (c >= '0' && c <= '9')
+		return c - '0' + 52;
+	if (c == '+')
+		return 62;
+	if (c == '/')
+		return 63;
+	return -1;
+}
+
+/* number of bytes that \n base64 characters decode to, ignoring padding */
+static inline size_t b64_decoded_max(size_t n)
+{
+	return n / 4 * 3;
+}
+
+/*
+ * Scalar kernels
+ */
+
+static void hex_enc_scalar(const uint8_t *s, size_t n, uint8_t *out)
+{
+	size_t i;
+
+	for (i = 0; i < n; ++i) {
+		*out++ = hex_chars[s[i] >> 4];
+		*out++ = hex_chars[s[i] & 0xf];
+	}
+}
+
+static bool hex_dec_scalar(const uint8_t *s, size_t n, uint8_t *out)
+{
+	int hi, lo;
+	size_t i;
+
+	for (i = 0; i < n; i += 2) {
+		hi = hex_value(s[i]);
+		lo = hex_value(s[i + 1]);
+		if (hi < 0 || lo < 0)
+			return false;
+		*out++ = (hi << 4) | lo;
+	}
+
+	return true;
+}
+
+static void b64_enc_scalar(const uint8_t *s, size_t n, uint8_t *out)
+{
+	uint32_t v;
+	size_t i;
+
+	for (i = 0; i + 3 <= n; i += 3) {
+		v = (s[i] << 16) | (s[i + 1] << 8) | s[i + 2];
+		*out++ = b64_chars[v >> 18];
+		*out++ = b64_chars[(v >> 12) & 0x3f];
+		*out++ = b64_chars[(v >> 6) & 0x3f];
+		*out++ = b64_chars[v & 0x3f];
+	}
+
+	if (n - i == 1) {
+		v = s[i] << 16;
+		*out++ = b64_chars[v >> 18];
+		*out++ = b64_chars[(v >> 12) & 0x3f];
+		*out++ = '=';
+		*out++ = '=';
+	} else if (n - i == 2) {
+		v = (s[i] << 16) | (s[i + 1] << 8);
+		*out++ = b64_chars[v >> 18];
+		*out++ = b64_chars[(v >> 12) & 0x3f];
+		*out++ = b64_chars[(v >> 6) & 0x3f];
+		*out++ = '=';
+	}
+}
+
+/* \n is a multiple of 4; padding is only allowed in the last quartet */
+static bool b64_dec_scalar(const uint8_t *s, size_t n, uint8_t *out)
+{
+	int a, b, c, d;
+	size_t i;
+
+	for (i = 0; i < n; i += 4) {
+		a = b64_value(s[i]);
+		b = b64_value(s[i + 1]);
+		if (a < 0 || b < 0)
+			return false;
+
+		if (i + 4 == n && s[i + 3] == '=') {
+			if (s[i + 2] == '=') {
+				/* one byte; the low 4 bits of \b are unused */
+				if (b & 0xf)
+					return false;
+				*out++ = (a << 2) | (b >> 4);
+			} else {
+				/* two bytes; the low 2 bits of \c are unused */
+				c = b64_value(s[i + 2]);
+				if (c < 0 || (c & 0x3))
+					return false;
+				*out++ = (a << 2) | (b >> 4);
+				*out++ = (b << 4) | (c >> 2);
+			}
+			return true;
+		}
+
+		c = b64_value(s[i + 2]);
+		d = b64_value(s[i + 3]);
+		if (c < 0 || d < 0)
+			return false;
+
+		*out++ = (a << 2) | (b >> 4);
+		*out++ = (b << 4) | (c >> 2);
+		*out++ = (c << 6) | d;
+	}
+
+	return true;
+}
+
+static const struct codec_ops ops_scalar = {
+	.hex_enc = hex_enc_scalar,
+	.hex_dec = hex_dec_scalar,
+	.b64_enc = b64_enc_scalar,
+	.b64_dec = b64_dec_scalar,
+};
+
+#ifdef CODEC_SIMD
+
+/*
+ * SSSE3 kernels
+ */
+
+__attribute__((target("ssse3")))
+static void hex_enc_ssse3(const uint8_t *s, size_t n, uint8_t *out)
+{
+	const __m128i lut = _mm_loadu_si128((const __m128i*)hex_chars);
+	const __m128i nib = _mm_set1_epi8(0x0f);
+	__m128i b, hi, lo;
+	size_t i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		b = _mm_loadu_si128((const __m128i*)&s[i]);
+		hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(b, 4),
+									nib));
+		lo = _mm_shuffle_epi8(lut, _mm_and_si128(b, nib));
+		_mm_storeu_si128((__m128i*)&out[2 * i],
+						_mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i*)&out[2 * i + 16],
+						_mm_unpackhi_epi8(hi, lo));
+	}
+
+	hex_enc_scalar(&s[i], n - i, &out[2 * i]);
+}
+
+/* converts 16 hex characters to their values; sets \err on invalid ones */
+__attribute__((target("ssse3")))
+static inline __m128i hex_values_ssse3(__m128i c, __m128i *err)
+{
+	__m128i d, l, isdig, islet;
+
+	d = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+	isdig = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+
+	l = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)),
+						_mm_set1_epi8('a'));
+	islet = _mm_cmpeq_epi8(_mm_min_epu8(l, _mm_set1_epi8(5)), l);
+
+	*err = _mm_or_si128(*err, _mm_andnot_si128(_mm_or_si128(isdig, islet),
+						_mm_set1_epi8(-1)));
+
+	return _mm_or_si128(_mm_and_si128(isdig, d), _mm_and_si128(islet,
+				_mm_add_epi8(l, _mm_set1_epi8(10))));
+}
+
+__attribute__((target("ssse3")))
+static bool hex_dec_ssse3(const uint8_t *s, size_t n, uint8_t *out)
+{
+	const __m128i weights = _mm_set1_epi16(0x0110);
+	__m128i err, a, b;
+	size_t i;
+
+	err = _mm_setzero_si128();
+	for (i = 0; i + 32 <= n; i += 32) {
+		a = hex_values_ssse3(_mm_loadu_si128((const __m128i*)&s[i]),
+									&err);
+		b = hex_values_ssse3(_mm_loadu_si128((const __m128i*)
+							&s[i + 16]), &err);
+		/* high nibble * 16 + low nibble for each pair */
+		a = _mm_maddubs_epi16(a, weights);
+		b = _mm_maddubs_epi16(b, weights);
+		_mm_storeu_si128((__m128i*)&out[i / 2], _mm_packus_epi16(a, b));
+	}
+
+	if (_mm_movemask_epi8(err))
+		return false;
+
+	return hex_dec_scalar(&s[i], n - i, &out[i / 2]);
+}
+
+__attribute__((target("ssse3")))
+static void b64_enc_ssse3(const uint8_t *s, size_t n, uint8_t *out)
+{
+	const __m128i shuf = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7,
+						4, 5, 3, 4, 1, 2, 0, 1);
+	const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			'0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A',
+			0, 0);
+	__m128i in, t0, t1, t2, t3, idx, r;
+	size_t i, o;
+
+	/* 12 bytes are encoded per block but 16 are loaded */
+	for (i = 0, o = 0; i + 16 <= n; i += 12, o += 16) {
+		in = _mm_loadu_si128((const __m128i*)&s[i]);
+		in = _mm_shuffle_epi8(in, shuf);
+
+		t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+		t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+		t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+		t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+		idx = _mm_or_si128(t1, t3);
+
+		/* 0-25: 13, 26-51: 0, 52-61: 1-10, 62: 11, 63: 12 */
+		r = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+		r = _mm_or_si128(r, _mm_and_si128(_mm_cmpgt_epi8(
+				_mm_set1_epi8(26), idx), _mm_set1_epi8(13)));
+		r = _mm_add_epi8(_mm_shuffle_epi8(offsets, r), idx);
+
+		_mm_storeu_si128((__m128i*)&out[o], r);
+	}
+
+	b64_enc_scalar(&s[i], n - i, &out[o]);
+}
+
+__attribute__((target("ssse3")))
+static bool b64_dec_ssse3(const uint8_t *s, size_t n, uint8_t *out)
+{
+	const __m128i shifts = _mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71,
+						0, 0, 0, 0, 0, 0, 0, 0);
+	/* bit \hi is set in entry \lo if the character 0x<hi><lo> is valid */
+	const __m128i masks = _mm_setr_epi8(0xa8, 0xf8, 0xf8, 0xf8, 0xf8,
+			0xf8, 0xf8, 0xf8, 0xf8, 0xf8, 0xf0, 0x54, 0x50, 0x50,
+			0x50, 0x54);
+	const __m128i bits = _mm_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20,
+			0x40, 0x80, 0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+			14, 13, 12, -1, -1, -1, -1);
+	const __m128i nib = _mm_set1_epi8(0x0f);
+	__m128i in, hi, sh, slash, bad, err, v;
+	size_t i, o;
+
+	/*
+	 * 16 bytes are stored per block but only 12 are valid. Keep the last
+	 * quartet with the padding and room for the overlap to the scalar
+	 * kernel.
+	 */
+	err = _mm_setzero_si128();
+	for (i = 0, o = 0; i + 24 <= n; i += 16, o += 12) {
+		in = _mm_loadu_si128((const __m128i*)&s[i]);
+		hi = _mm_and_si128(_mm_srli_epi32(in, 4), nib);
+
+		bad = _mm_cmpeq_epi8(_mm_and_si128(
+				_mm_shuffle_epi8(masks, _mm_and_si128(in, nib)),
+				_mm_shuffle_epi8(bits, hi)),
+				_mm_setzero_si128());
+		err = _mm_or_si128(err, bad);
+
+		/* '/' shares its high nibble with '+' but needs 16 */
+		slash = _mm_cmpeq_epi8(in, _mm_set1_epi8('/'));
+		sh = _mm_shuffle_epi8(shifts, hi);
+		sh = _mm_or_si128(_mm_andnot_si128(slash, sh),
+				_mm_and_si128(slash, _mm_set1_epi8(16)));
+		v = _mm_add_epi8(in, sh);
+
+		v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+		v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+		_mm_storeu_si128((__m128i*)&out[o], _mm_shuffle_epi8(v, pack));
+	}
+
+	if (_mm_movemask_epi8(err))
+		return false;
+
+	return b64_dec_scalar(&s[i], n - i, &out[o]);
+}
+
+static const struct codec_ops ops_ssse3 = {
+	.hex_enc = hex_enc_ssse3,
+	.hex_dec = hex_dec_ssse3,
+	.b64_enc = b64_enc_ssse3,
+	.b64_dec = b64_dec_ssse3,
+};
+
+#endif /* CODEC_SIMD */
+
+/* select the kernels for this CPU, see cpu.c */
+static const struct codec_ops *codec_ops(void)
+{
+#ifdef CODEC_SIMD
+	if (cstr__isa() >= CSTR__ISA_SSSE3)
+		return &ops_ssse3;
+#endif
+
+	return &ops_scalar;
+}
+
+/*
+ * Extends \dest by \n bytes and returns a pointer to them or NULL on memory
+ * allocation failure. \src may be \dest, so the source pointer is stored in
+ * \s after the buffer was resized.
+ */
+static uint8_t *append(cstr *dest, const cstr *src, const uint8_t **s,
+								size_t n)
+{
+	size_t len = dest->len;
+
+	if (!cstr__fit(dest, len + n, false))
+		return NULL;
+
+	*s = CSTR_UINT8(src);
+	return dest->buf + len;
+}
+
+/* drops the partial output of a failed decoder */
+static void reset_len(cstr *dest, size_t len)
+{
+	dest->len = len;
+	dest->buf[len] = 0;
+}
+
+/*
+ * Hex encoding
+ * Appends the lower-case hexadecimal representation of \src to \dest.
+ * Returns false on memory allocation failure.
+ */
+bool cstr_hex_encode(cstr *dest, const cstr *src)
+{
+	size_t n = CSTR_LEN(src);
+	const uint8_t *s;
+	uint8_t *out;
+
+	out = append(dest, src, &s, n * 2);
+	if (!out)
+		return false;
+
+	codec_ops()->hex_enc(s, n, out);
+	return true;
+}
+
+/*
+ * Hex decoding
+ * Decodes the hexadecimal string \src and appends the result to \dest. Upper-
+ * and lower-case characters are accepted.
+ * Returns 0 on success, -EINVAL if \src is not a valid hexadecimal string or
+ * -ENOMEM on memory allocation failure.
+ */
+int cstr_hex_decode(cstr *dest, const cstr *src)
+{
+	size_t len = dest->len, n = CSTR_LEN(src);
+	const uint8_t *s;
+	uint8_t *out;
+
+	if (n % 2)
+		return -EINVAL;
+
+	out = append(dest, src, &s, n / 2);
+	if (!out)
+		return -ENOMEM;
+
+	if (!codec_ops()->hex_dec(s, n, out)) {
+		reset_len(dest, len);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/*
+ * Base64 encoding
+ * Appends the base64 representation of \src with padding to \dest.
+ * Returns false on memory allocation failure.
+ */
+bool cstr_base64_encode(cstr *dest, const cstr *src)
+{
+	size_t n = CSTR_LEN(src);
+	const uint8_t *s;
+	uint8_t *out;
+
+	out = append(dest, src, &s, (n + 2) / 3 * 4);
+	if (!out)
+		return false;
+
+	codec_ops()->b64_enc(s, n, out);
+	return true;
+}
+
+/*
+ * Base64 decoding
+ * Decodes the padded base64 string \src and appends the result to \dest.
+ * Returns 0 on success, -EINVAL if \src is not valid base64 or -ENOMEM on
+ * memory allocation failure.
+ */
+int cstr_base64_decode(cstr *dest, const cstr *src)
+{
+	size_t len = dest->len, n = CSTR_LEN(src), pad;
+	const uint8_t *s;
+	uint8_t *out;
+
+	if (n % 4)
+		return -EINVAL;
+
+	pad = 0;
+	if (n && CSTR_UINT8(src)[n - 1] == '=')
+		pad = CSTR_UINT8(src)[n - 2] == '=' ? 2 : 1;
+
+	out = append(dest, src, &s, b64_decoded_max(n));
+	if (!out)
+		return -ENOMEM;
+
+	if (!codec_ops()->b64_dec(s, n, out)) {
+		reset_len(dest, len);
+		return -EINVAL;
+	}
+
+	reset_len(dest, len + b64_decoded_max(n) - pad);
+	return 0;
+}
@@ -0,0 +1,59 @@
+/*
+ * Static C-strings and arrays
+ * Written 2011 by David Herrmann
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * CPU Features
+ * The search, UTF-8 and codec functions select their vector kernels by the
+ * instruction sets returned by cstr__isa(). The CPU is examined once on first
+ * use. Concurrent first calls may both run the detection but store the same
+ * result. cstr__isa_limit() only lowers the result, so tests can run the
+ * kernels of every instruction set the CPU supports, see cstr.h.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "cstr.h"
+#include "libcstr.h"
+
+static unsigned int isa_limit = CSTR__ISA_AVX2;
+
+static unsigned int isa_detect(void)
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return CSTR__ISA_AVX2;
+	if (__builtin_cpu_supports("ssse3"))
+		return CSTR__ISA_SSSE3;
+	/* SSE2 is part of x86-64 */
+	return CSTR__ISA_SSE2;
+#else
+	return CSTR__ISA_SCALAR;
+#endif
+}
+
+unsigned int cstr__isa(void)
+{
+	static int isa = -1;
+	unsigned int res, limit;
+	int r;
+
+	r = __atomic_load_n(&isa, __ATOMIC_RELAXED);
+	if (r < 0) {
+		r = isa_detect();
+		__atomic_store_n(&isa, r, __ATOMIC_RELAXED);
+	}
+
+	res = r;
+	limit = __atomic_load_n(&isa_limit, __ATOMIC_RELAXED);
+	return res < limit ? res : limit;
+}
+
+void cstr__isa_limit(unsigned int isa)
+{
+	__atomic_store_n(&isa_limit, isa, __ATOMIC_RELAXED);
+}
@@ -23,8 +23,22 @@
  * required. However, many strings do not need to be manipulated and hence do
  * not need a big buffer. Therefore, many functions take as last argument a
  * \constant boolean which should be true if no additional buffer space should
- * be allocated. If it is false, the buffer size is always twice as big as
- * requested. The default value is false.
+ * be allocated. If it is false, the buffer size is chosen by a growth policy
+ * which doubles it by default. The default value is false.
+ *
+ * Short buffers are stored inline. That is, the buffer is allocated together
+ * with the object in a single memory block and \buf points right behind the
+ * cstr header. Such objects have CSTR_F_INLINE set and their size is
+ * non-negative like other owned buffers. However, the buffer must never be
+ * passed to free() or realloc(). If an inline buffer needs to grow, a new
+ * buffer is allocated on the heap and the inline space is left unused until
+ * the object is freed.
+ *
+ * Shared buffers are reference counted and read-only, see shared.c. Objects
+ * using them have a negative size like other buffers we do not own, but
+ * cstr__fit() always replaces them by a private buffer, even if they are big
+ * enough. Duplicating them does not copy the buffer at all. Memory mapped files
+ * are handled the same way, see mmap.c.
  */
 
 #include <assert.h>
@@ -32,6 +46,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include "cstr.h"
 #include "libcstr.h"
 
 /*
@@ -45,6 +60,8 @@
  * In all cases, abs(\size) must be greater than or equal to \len.
  * If \buf is non-NULL, then buffer pointed to by \buf must be at least of size
  * abs(\size) + 1. The +1 is important!
+ * If a new buffer is allocated and \size is not bigger than CSTR_INLINE_MAX,
+ * then the buffer is stored inline and the object needs only one allocation.
  *
  * This returns NULL on memory allocation errors, otherwise it returns the new
  * cstr object.
@@ -53,23 +70,35 @@ cstr *cstr_alloc(size_t len, ssize_t size, void *buf)
 {
 	cstr *str;
 
-	assert(len <= abs(size));
+	assert((ssize_t)len <= (size < 0 ? -size : size));
 
-	str = malloc(sizeof(*str));
-	if (!str)
-		return NULL;
+	if (size >= 0 && size <= CSTR_INLINE_MAX && !buf) {
+		str = cstr__malloc(sizeof(*str) + size + 1);
+		if (!str)
+			return NULL;
 
-	if (size >= 0 && !buf) {
-		str->buf = malloc(size + 1);
-		if (!str->buf) {
-			free(str);
+		str->buf = (uint8_t*)(str + 1);
+		str->flags = CSTR_F_INLINE;
+	} else {
+		str = cstr__malloc(sizeof(*str));
+		if (!str)
 			return NULL;
+
+		if (size >= 0 && !buf) {
+			str->buf = cstr__malloc(size + 1);
+			if (!str->buf) {
+				cstr__free(str);
+				return NULL;
+			}
+		} else {
+			assert(buf);
+			str->buf = buf;
 		}
-	} else {
-		assert(buf);
-		str->buf = buf;
+
+		str->flags = 0;
 	}
 
+	str->arena = NULL;
 	str->len = len;
 	str->size = size;
 	str->buf[len] = 0;
@@ -85,14 +114,24 @@ cstr *cstr_alloc(size_t len, ssize_t size, void *buf)
  * You do not need to call this on dynamically allocated cstr objects as
  * cstr_free() also frees the buffers. However, statically allocated cstr
  * objects which are not constant must be freed with this function.
+ * Arena objects are left untouched as they are released with their arena.
  */
 void cstr_clear(cstr *str)
 {
-	if (str->size >= 0)
-		free(str->buf);
+	if (str->flags & CSTR_F_ARENA)
+		return;
+
+	if (str->flags & CSTR_F_SHARED)
+		cstr__shared_unref(str->buf);
+	else if (str->flags & CSTR_F_MMAP)
+		cstr__mmap_release(str);
+	else if (str->size >= 0 && !(str->flags & CSTR_F_INLINE))
+		cstr__free(str->buf);
 	str->len = 0;
 	str->size = 0;
 	str->buf = NULL;
+	str->flags = 0;
+	str->arena = NULL;
 }
 
 /*
@@ -101,9 +140,18 @@ void cstr_clear(cstr *str)
  */
 void cstr_free(cstr *str)
 {
-	if (str) {
+	if (str && !(str->flags & CSTR_F_ARENA)) {
 		cstr_clear(str);
-		free(str);
+		cstr__free(str);
+	}
+}
+
+/* counts a buffer that moved while growing, see stats.c */
+static inline void stat_reloc(const void *sold, const void *snew, size_t copy)
+{
+	if (sold != snew) {
+		CSTR__STAT(relocs, 1);
+		CSTR__STAT(reloc_bytes, copy);
 	}
 }
 
@@ -118,30 +166,62 @@ void cstr_free(cstr *str)
  * This returns false if the new buffer cannot be allocated. Otherwise it
  * returns true.
  * If a new buffer is allocated and \constant is true, the new buffer will have
- * the exact same size as required. If \constant is false, the buffer will be
- * twice as big as required.
+ * the exact same size as required. If \constant is false, the size is chosen
+ * by the growth policy of \str, see alloc.c.
  * \str is not touched at all if the memory allocation fails and false is
  * returned. So on failure the old state is preserved.
+ * Buffers that we do not own and inline buffers cannot be passed to realloc()
+ * so their content is copied into the new buffer instead. Arena objects get
+ * their new buffer from their arena. Shared buffers and mapped files are
+ * always replaced by a private copy as they must not be modified.
  */
 bool cstr__fit(cstr *str, size_t len, bool constant)
 {
 	void *snew;
-	size_t size;
+	uint8_t *sold;
+	size_t size, copy;
 
 	assert(str);
 
-	if (abs(str->size) < (ssize_t)len) {
+	cstr_hash_reset(str);
+
+	if (CSTR_SIZE(str) < (ssize_t)len || (str->flags & CSTR_F_RDONLY)) {
 		if (constant)
 			size = len;
 		else
-			size = len * 2;
+			size = cstr__grow_size(str, len);
 
-		if (str->size < 0)
-			snew = malloc(size + 1);
-		else
-			snew = realloc(str->buf, size + 1);
-		if (!snew)
-			return false;
+		sold = str->buf;
+		copy = str->len < len ? str->len : len;
+
+		if (str->flags & CSTR_F_ARENA) {
+			if (!cstr__arena_grow(str, size))
+				return false;
+			snew = str->buf;
+			stat_reloc(sold, snew, copy);
+		} else if (str->size < 0 ||
+				(str->flags & (CSTR_F_INLINE | CSTR_F_RDONLY))) {
+			snew = cstr__malloc(size + 1);
+			if (!snew)
+				return false;
+			memcpy(snew, str->buf, copy);
+			if (str->flags & CSTR_F_SHARED)
+				cstr__shared_unref(str->buf);
+			else if (str->flags & CSTR_F_MMAP)
+				cstr__mmap_release(str);
+			if (str->flags & CSTR_F_INLINE) {
+				stat_reloc(sold, snew, copy);
+			} else {
+				CSTR__STAT(copyouts, 1);
+				CSTR__STAT(copyout_bytes, copy);
+			}
+			str->flags &= ~(CSTR_F_INLINE | CSTR_F_RDONLY);
+		} else {
+			snew = cstr__realloc(str->buf, size + 1);
+			if (!snew)
+				return false;
+			stat_reloc(sold, snew, copy);
+		}
 		str->buf = snew;
 		str->size = size;
 	}
@@ -159,6 +239,7 @@ bool cstr__fit(cstr *str, size_t len, bool constant)
  * Returns NULL on memory allocation errors.
  * The buffer of the new object may be of different size as \old. \constant
  * specifies how the new buffer is allocated.
+ * If \old uses a shared buffer, the new object shares it, too.
  */
 cstr *cstr__dup(const cstr *old, bool constant)
 {
@@ -166,6 +247,9 @@ cstr *cstr__dup(const cstr *old, bool constant)
 
 	assert(old);
 
+	if (old->flags & CSTR_F_SHARED)
+		return cstr__shared_dup(old);
+
 	if (constant)
 		dest = cstr_cnew(CSTR_LEN(old));
 	else
@@ -185,22 +269,29 @@ cstr *cstr__dup(const cstr *old, bool constant)
 bool cstr__cat(cstr *dest, const cstr *src, bool constant)
 {
 	size_t dlen = CSTR_LEN(dest);
+	size_t slen = CSTR_LEN(src);
 
-	if (!cstr__fit(dest, dlen + CSTR_LEN(src), constant))
+	if (!cstr__fit(dest, dlen + slen, constant))
 		return false;
 
-	memcpy(CSTR_UINT8(dest) + dlen, CSTR_VOID(src), CSTR_LEN(src));
+	memcpy(CSTR_UINT8(dest) + dlen, CSTR_VOID(src), slen);
 	return true;
 }
 
 /*
  * Compare strings
- * Returns true if \str1 and \str2 are equal.
+ * Returns true if \str1 and \str2 are equal. Identical objects, like interned
+ * strings of the same table, are detected without looking at the buffers. If
+ * both strings have a cached hash, differing hashes reject them, too.
  */
 bool cstr_cmp(const cstr *str1, const cstr *str2)
 {
+	if (str1 == str2)
+		return true;
 	if (CSTR_LEN(str1) != CSTR_LEN(str2))
 		return false;
+	if ((str1->flags & str2->flags & CSTR_F_HASHED) && str1->hash != str2->hash)
+		return false;
 
 	return !memcmp(CSTR_VOID(str1), CSTR_VOID(str2), CSTR_LEN(str1));
 }
@@ -236,3 +327,125 @@ bool cstr__cpy(cstr *dest, const cstr *src, bool constant)
 	memcpy(CSTR_VOID(dest), CSTR_VOID(src), CSTR_LEN(src));
 	return true;
 }
+
+/*
+ * Allocate single-block string
+ * This works like cstr_alloc() with a NULL buffer but always stores the buffer
+ * inline, regardless of \size. The object and its buffer are allocated with a
+ * single allocation and released with a single free.
+ * Returns NULL on memory allocation errors.
+ */
+cstr *cstr_ialloc(size_t len, size_t size)
+{
+	cstr *str;
+
+	assert(len <= size);
+
+	str = cstr__malloc(sizeof(*str) + size + 1);
+	if (!str)
+		return NULL;
+
+	str->len = len;
+	str->size = size;
+	str->buf = (uint8_t*)(str + 1);
+	str->flags = CSTR_F_INLINE;
+	str->arena = NULL;
+	str->buf[len] = 0;
+
+	return str;
+}
+
+/*
+ * Resize single-block string
+ * This works like cstr__fit() but if the buffer of *\str is stored inline and
+ * is too small, the whole object is reallocated so the buffer stays inline.
+ * *\str is updated to point to the new object in this case and the old pointer
+ * is invalid afterwards.
+ * If the buffer is not stored inline, this is identical to cstr__fit().
+ * On failure, false is returned and *\str is left untouched.
+ */
+bool cstr__ifit(cstr **str, size_t len, bool constant)
+{
+	cstr *snew;
+	size_t size;
+
+	assert(str && *str);
+
+	if (!((*str)->flags & CSTR_F_INLINE) ||
+					CSTR_SIZE(*str) >= (ssize_t)len)
+		return cstr__fit(*str, len, constant);
+
+	if (constant)
+		size = len;
+	else
+		size = cstr__grow_size(*str, len);
+
+	snew = cstr__realloc(*str, sizeof(*snew) + size + 1);
+	if (!snew)
+		return false;
+
+	snew->buf = (uint8_t*)(snew + 1);
+	snew->size = size;
+	snew->len = len;
+	snew->flags &= ~CSTR_F_HASHED;
+	snew->buf[len] = 0;
+	*str = snew;
+
+	return true;
+}
+
+/*
+ * Duplicate into single-block string
+ * Like cstr__dup() but the new object always stores its buffer inline.
+ */
+cstr *cstr__idup(const cstr *old, bool constant)
+{
+	cstr *dest;
+
+	assert(old);
+
+	if (constant)
+		dest = cstr_cinew(CSTR_LEN(old));
+	else
+		dest = cstr_inew(CSTR_LEN(old));
+	if (!dest)
+		return NULL;
+
+	memcpy(CSTR_VOID(dest), CSTR_VOID(old), CSTR_LEN(old));
+	return dest;
+}
+
+/*
+ * Concatenate into single-block string
+ * Like cstr__cat() but uses cstr__ifit() to resize *\dest. \src may be equal
+ * to *\dest.
+ */
+bool cstr__icat(cstr **dest, const cstr *src, bool constant)
+{
+	size_t dlen = CSTR_LEN(*dest);
+	size_t slen = CSTR_LEN(src);
+	bool self = src == *dest;
+
+	if (!cstr__ifit(dest, dlen + slen, constant))
+		return false;
+
+	/* the object may have moved */
+	if (self)
+		src = *dest;
+
+	memcpy(CSTR_UINT8(*dest) + dlen, CSTR_VOID(src), slen);
+	return true;
+}
+
+/*
+ * Copy into single-block string
+ * Like cstr__cpy() but uses cstr__ifit() to resize *\dest.
+ */
+bool cstr__icpy(cstr **dest, const cstr *src, bool constant)
+{
+	if (!cstr__ifit(dest, CSTR_LEN(src), constant))
+		return false;
+
+	memcpy(CSTR_VOID(*dest), CSTR_VOID(src), CSTR_LEN(src));
+	return true;
+}
@@ -0,0 +1,514 @@
+/*
+ * Static C-strings and arrays
+ * Written 2011 by David Herrmann
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * Formatting
+ * All functions here append to a string and write directly into its buffer
+ * instead of formatting into a temporary buffer first. cstr_appendf() tries
+ * vsnprintf() on the spare capacity of the buffer and only formats a second
+ * time if it did not fit. Integers are converted two digits at a time with a
+ * lookup table after the number of digits is known, so they are written in
+ * place, too. Doubles are converted without the C library, so the result does
+ * not depend on the locale, see shortest().
+ */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cstr.h"
+#include "libcstr.h"
+
+static const char digit_pairs[201] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+/* extends \str by \n bytes and returns a pointer to the new bytes */
+static uint8_t *append(cstr *str, size_t n)
+{
+	size_t len = str->len;
+
+	if (!cstr__fit(str, len + n, false))
+		return NULL;
+
+	return str->buf + len;
+}
+
+/*
+ * Formatted append
+ * Formats \format like printf() and appends the result to \str.
+ * Returns false on memory allocation failure or if \format is invalid.
+ */
+bool cstr_vappendf(cstr *str, const char *format, va_list args)
+{
+	size_t len, spare;
+	uint8_t *p;
+	va_list copy;
+	int r;
+
+	cstr_hash_reset(str);
+
+	len = str->len;
+	spare = 0;
+	if (!(str->flags & CSTR_F_RDONLY) && CSTR_SIZE(str) > (ssize_t)len)
+		spare = CSTR_SIZE(str) - len + 1;
+
+	va_copy(copy, args);
+	r = vsnprintf(spare ? (char*)str->buf + len : NULL, spare, format, copy);
+	va_end(copy);
+	if (r < 0)
+		goto err_term;
+
+	if ((size_t)r < spare) {
+		str->len += r;
+		return true;
+	}
+
+	p = append(str, r);
+	if (!p)
+		goto err_term;
+
+	vsnprintf((char*)p, r + 1, format, args);
+	return true;
+
+err_term:
+	/* the first try may have written into the spare capacity */
+	if (spare)
+		str->buf[len] = 0;
+	return false;
+}
+
+bool cstr_appendf(cstr *str, const char *format, ...)
+{
+	va_list args;
+	bool ret;
+
+	va_start(args, format);
+	ret = cstr_vappendf(str, format, args);
+	va_end(args);
+
+	return ret;
+}
+
+static unsigned int count_digits(uint64_t v)
+{
+	unsigned int n = 1;
+
+	while (1) {
+		if (v < 10)
+			return n;
+		if (v < 100)
+			return n + 1;
+		if (v < 1000)
+			return n + 2;
+		if (v < 10000)
+			return n + 3;
+		v /= 10000;
+		n += 4;
+	}
+}
+
+/* writes the digits of \v backwards, ending right before \end */
+static void write_digits(uint8_t *end, uint64_t v)
+{
+	unsigned int i;
+
+	while (v >= 100) {
+		i = (v % 100) * 2;
+		v /= 100;
+		*--end = digit_pairs[i + 1];
+		*--end = digit_pairs[i];
+	}
+
+	if (v >= 10) {
+		i = v * 2;
+		*--end = digit_pairs[i + 1];
+		*--end = digit_pairs[i];
+	} else {
+		*--end = '0' + v;
+	}
+}
+
+/*
+ * Append integer
+ * Appends the decimal representation of \v to \str.
+ * Returns false on memory allocation failure.
+ */
+bool cstr_append_u64(cstr *str, uint64_t v)
+{
+	unsigned int n;
+	uint8_t *p;
+
+	n = count_digits(v);
+	p = append(str, n);
+	if (!p)
+		return false;
+
+	write_digits(p + n, v);
+	return true;
+}
+
+bool cstr_append_i64(cstr *str, int64_t v)
+{
+	unsigned int n;
+	uint64_t u;
+	uint8_t *p;
+
+	/* negate as unsigned so INT64_MIN does not overflow */
+	u = v < 0 ? -(uint64_t)v : (uint64_t)v;
+	n = count_digits(u);
+
+	p = append(str, n + (v < 0));
+	if (!p)
+		return false;
+
+	if (v < 0)
+		*p++ = '-';
+	write_digits(p + n, u);
+	return true;
+}
+
+/*
+ * Append hexadecimal integer
+ * Appends the lower-case hexadecimal representation of \v to \str without any
+ * prefix or leading zeros.
+ * Returns false on memory allocation failure.
+ */
+bool cstr_append_hex(cstr *str, uint64_t v)
+{
+	static const char hex[] = "0123456789abcdef";
+	unsigned int n;
+	uint8_t *p;
+
+	n = v ? (67 - __builtin_clzll(v)) / 4 : 1;
+	p = append(str, n);
+	if (!p)
+		return false;
+
+	p += n;
+	do {
+		*--p = hex[v & 0xf];
+		v >>= 4;
+	} while (v);
+
+	return true;
+}
+
+/*
+ * Arbitrary precision integers for the digit generation of doubles. The scaled
+ * values of any double and its boundaries need less than 1100 bits, see
+ * shortest(). Words are stored least significant first and \n never counts
+ * leading zero words.
+ */
+#define BIG_WORDS 40
+
+struct big {
+	unsigned int n;
+	uint32_t w[BIG_WORDS];
+};
+
+static void big_set(struct big *b, uint64_t v)
+{
+	b->n = 0;
+	while (v) {
+		b->w[b->n++] = v;
+		v >>= 32;
+	}
+}
+
+static void big_shl(struct big *b, unsigned int bits)
+{
+	unsigned int words = bits / 32, i;
+	uint32_t w, carry = 0;
+
+	bits %= 32;
+	if (!b->n)
+		return;
+
+	if (bits) {
+		for (i = 0; i < b->n; ++i) {
+			w = b->w[i];
+			b->w[i] = (w << bits) | carry;
+			carry = w >> (32 - bits);
+		}
+		if (carry)
+			b->w[b->n++] = carry;
+	}
+
+	if (words) {
+		memmove(&b->w[words], b->w, b->n * sizeof(*b->w));
+		memset(b->w, 0, words * sizeof(*b->w));
+		b->n += words;
+	}
+}
+
+static void big_mul(struct big *b, uint32_t m)
+{
+	uint64_t carry = 0;
+	unsigned int i;
+
+	for (i = 0; i < b->n; ++i) {
+		carry += (uint64_t)b->w[i] * m;
+		b->w[i] = carry;
+		carry >>= 32;
+	}
+	if (carry)
+		b->w[b->n++] = carry;
+}
+
+static void big_mul_pow10(struct big *b, unsigned int exp)
+{
+	static const uint32_t pow10[9] = {
+		1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000,
+	};
+
+	for ( ; exp >= 9; exp -= 9)
+		big_mul(b, 1000000000);
+	if (exp)
+		big_mul(b, pow10[exp]);
+}
+
+/* dest = a + b, \dest may be \a or \b */
+static void big_add(struct big *dest, const struct big *a, const struct big *b)
+{
+	unsigned int i, n = a->n > b->n ? a->n : b->n;
+	uint64_t carry = 0;
+
+	for (i = 0; i < n; ++i) {
+		carry += (uint64_t)(i < a->n ? a->w[i] : 0) +
+						(i < b->n ? b->w[i] : 0);
+		dest->w[i] = carry;
+		carry >>= 32;
+	}
+	dest->n = n;
+	if (carry)
+		dest->w[dest->n++] = carry;
+}
+
+/* a -= b, \a must not be smaller than \b */
+static void big_sub(struct big *a, const struct big *b)
+{
+	uint64_t borrow = 0, d;
+	unsigned int i;
+
+	for (i = 0; i < a->n; ++i) {
+		d = (uint64_t)a->w[i] - (i < b->n ? b->w[i] : 0) - borrow;
+		a->w[i] = d;
+		borrow = d >> 63;
+	}
+	while (a->n && !a->w[a->n - 1])
+		--a->n;
+}
+
+static int big_cmp(const struct big *a, const struct big *b)
+{
+	unsigned int i;
+
+	if (a->n != b->n)
+		return a->n < b->n ? -1 : 1;
+
+	for (i = a->n; i-- > 0; ) {
+		if (a->w[i] != b->w[i])
+			return a->w[i] < b->w[i] ? -1 : 1;
+	}
+
+	return 0;
+}
+
+/* returns whether a + b reaches \limit, which includes equality if \incl */
+static bool big_reaches(const struct big *a, const struct big *b,
+					const struct big *limit, bool incl)
+{
+	struct big t;
+	int r;
+
+	big_add(&t, a, b);
+	r = big_cmp(&t, limit);
+	return r > 0 || (incl && !r);
+}
+
+/*
+ * Shortest digits
+ * Writes the shortest digits that read back as f * 2^e to \digits and returns
+ * their number. \exp is set so the value is 0.d1d2d3... * 10^exp. \asym is set
+ * if the next smaller double is closer than the next bigger one, which happens
+ * for powers of two.
+ * This is the free-format algorithm of Steele & White and Burger & Dybvig. The
+ * value is kept as fraction r / s and the distances to the midpoints between
+ * the value and its neighbours as mp / s and mm / s. All values are exact so
+ * there are no corner cases where the result does not round-trip. Midpoints
+ * belong to the value if the mantissa is even, as strtod() rounds half to even.
+ * If the last digit can be rounded either way, the closer one is taken.
+ */
+static unsigned int shortest(uint8_t *digits, int *exp, uint64_t f, int e,
+								bool asym)
+{
+	struct big r, s, mp, mm, t;
+	bool even = !(f & 1), low, high;
+	unsigned int n, d;
+	int k, c;
+
+	big_set(&r, f);
+	big_set(&mp, 1);
+	big_set(&mm, 1);
+	if (e >= 0) {
+		big_shl(&r, e + 1 + asym);
+		big_set(&s, 2 << asym);
+		big_shl(&mp, e + asym);
+		big_shl(&mm, e);
+	} else {
+		big_shl(&r, 1 + asym);
+		big_set(&s, 1);
+		big_shl(&s, 1 - e + asym);
+		big_shl(&mp, asym);
+	}
+
+	/*
+	 * Scale by 10^k so the upper midpoint is just below 1. The estimate is
+	 * floor(log10(2^floor(log2(v)))) + 1 which is never too big and at most
+	 * two too small.
+	 */
+	k = ((e + 63 - __builtin_clzll(f)) * 78913 >> 18) + 1;
+	if (k >= 0) {
+		big_mul_pow10(&s, k);
+	} else {
+		big_mul_pow10(&r, -k);
+		big_mul_pow10(&mp, -k);
+		big_mul_pow10(&mm, -k);
+	}
+	while (big_reaches(&r, &mp, &s, even)) {
+		big_mul(&s, 10);
+		++k;
+	}
+
+	n = 0;
+	do {
+		big_mul(&r, 10);
+		big_mul(&mp, 10);
+		big_mul(&mm, 10);
+
+		for (d = 0; big_cmp(&r, &s) >= 0; ++d)
+			big_sub(&r, &s);
+
+		c = big_cmp(&r, &mm);
+		low = c < 0 || (even && !c);
+		high = big_reaches(&r, &mp, &s, even);
+		if (low && high) {
+			big_add(&t, &r, &r);
+			c = big_cmp(&t, &s);
+			if (c > 0 || (!c && (d & 1)))
+				++d;
+		} else if (high) {
+			++d;
+		}
+
+		digits[n++] = '0' + d;
+	} while (!low && !high);
+
+	*exp = k;
+	return n;
+}
+
+/*
+ * Append floating point number
+ * Appends the shortest decimal representation of \v that reads back as the
+ * same value with strtod(). Like with %g, exponent notation is used if the
+ * decimal exponent is less than -4 or not less than the number of digits, but
+ * at least 15 digits are allowed in that comparison. So the result looks like
+ * the first of %.15g, %.16g and %.17g that round-trips. Infinities and NaNs are
+ * written as "inf" and "nan" with an optional sign.
+ * The output does not depend on the locale, the decimal point is always '.'.
+ * Returns false on memory allocation failure.
+ */
+bool cstr_append_double(cstr *str, double v)
+{
+	uint8_t digits[17], *p;
+	unsigned int n, size;
+	uint64_t bits, f;
+	int e, x;
+	bool neg, sci;
+
+	memcpy(&bits, &v, sizeof(bits));
+	neg = bits >> 63;
+	e = (bits >> 52) & 0x7ff;
+	f = bits & ((1ULL << 52) - 1);
+
+	if (e == 0x7ff) {
+		if (f)
+			return cstr_cat(str, neg ? CSTR("-nan") : CSTR("nan"));
+		return cstr_cat(str, neg ? CSTR("-inf") : CSTR("inf"));
+	}
+	if (!e && !f)
+		return cstr_cat(str, neg ? CSTR("-0") : CSTR("0"));
+
+	if (e)
+		n = shortest(digits, &x, f | (1ULL << 52), e - 1075,
+								!f && e > 1);
+	else
+		n = shortest(digits, &x, f, -1074, false);
+
+	/* decimal exponent of the first digit */
+	--x;
+	sci = x < -4 || x >= (int)(n > 15 ? n : 15);
+
+	if (sci)
+		size = n + (n > 1) + (x <= -100 || x >= 100 ? 5 : 4);
+	else if (x < 0)
+		size = n + 1 - x;
+	else if ((int)n <= x + 1)
+		size = x + 1;
+	else
+		size = n + 1;
+
+	p = append(str, neg + size);
+	if (!p)
+		return false;
+
+	if (neg)
+		*p++ = '-';
+
+	if (sci) {
+		*p++ = digits[0];
+		if (n > 1) {
+			*p++ = '.';
+			memcpy(p, &digits[1], n - 1);
+			p += n - 1;
+		}
+		*p++ = 'e';
+		*p++ = x < 0 ? '-' : '+';
+		x = abs(x);
+		if (x < 10)
+			*p++ = '0';
+		write_digits(p + count_digits(x), x);
+	} else if (x < 0) {
+		/* 0.00ddd */
+		*p++ = '0';
+		*p++ = '.';
+		memset(p, '0', -x - 1);
+		memcpy(p - x - 1, digits, n);
+	} else if ((int)n <= x + 1) {
+		/* ddd00 */
+		memcpy(p, digits, n);
+		memset(p + n, '0', x + 1 - n);
+	} else {
+		/* dd.ddd */
+		memcpy(p, digits, x + 1);
+		p[x + 1] = '.';
+		memcpy(p + x + 2, &digits[x + 1], n - x - 1);
+	}
+
+	return true;
+}
@@ -0,0 +1,153 @@
+/*
+ * Static C-strings and arrays
+ * Written 2011 by David Herrmann
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * Hashing
+ * This implements the XXH64 algorithm by Yann Collet. Input is consumed in
+ * 32 byte stripes by four independent 64bit accumulators, so the main loop is
+ * not serialized on a single multiply chain and runs at several bytes per
+ * cycle. The tail and short strings are mixed in 8, 4 and 1 byte steps and a
+ * final avalanche spreads all input bits over the result.
+ * The hash is not cryptographically secure. Use a random seed if the input is
+ * controlled by an attacker.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "libcstr.h"
+
+#define P1 0x9E3779B185EBCA87ULL
+#define P2 0xC2B2AE3D27D4EB4FULL
+#define P3 0x165667B19E3779F9ULL
+#define P4 0x85EBCA77C2B2AE63ULL
+#define P5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t rotl(uint64_t v, unsigned int r)
+{
+	return (v << r) | (v >> (64 - r));
+}
+
+/* unaligned little-endian loads */
+static inline uint64_t read64(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+static inline uint32_t read32(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	return v;
+}
+
+static inline uint64_t round64(uint64_t acc, uint64_t input)
+{
+	acc += input * P2;
+	acc = rotl(acc, 31);
+	return acc * P1;
+}
+
+static inline uint64_t merge64(uint64_t acc, uint64_t val)
+{
+	acc ^= round64(0, val);
+	return acc * P1 + P4;
+}
+
+static uint64_t hash64(const uint8_t *p, size_t len, uint64_t seed)
+{
+	const uint8_t *end = p + len;
+	uint64_t v1, v2, v3, v4, h;
+
+	if (len >= 32) {
+		v1 = seed + P1 + P2;
+		v2 = seed + P2;
+		v3 = seed;
+		v4 = seed - P1;
+
+		do {
+			v1 = round64(v1, read64(p));
+			v2 = round64(v2, read64(p + 8));
+			v3 = round64(v3, read64(p + 16));
+			v4 = round64(v4, read64(p + 24));
+			p += 32;
+		} while (end - p >= 32);
+
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		h = merge64(h, v1);
+		h = merge64(h, v2);
+		h = merge64(h, v3);
+		h = merge64(h, v4);
+	} else {
+		h = seed + P5;
+	}
+
+	h += len;
+
+	for ( ; end - p >= 8; p += 8) {
+		h ^= round64(0, read64(p));
+		h = rotl(h, 27) * P1 + P4;
+	}
+
+	if (end - p >= 4) {
+		h ^= read32(p) * P1;
+		h = rotl(h, 23) * P2 + P3;
+		p += 4;
+	}
+
+	for ( ; p < end; ++p) {
+		h ^= *p * P5;
+		h = rotl(h, 11) * P1;
+	}
+
+	h ^= h >> 33;
+	h *= P2;
+	h ^= h >> 29;
+	h *= P3;
+	h ^= h >> 32;
+
+	return h;
+}
+
+/*
+ * Hash string with seed
+ * Returns the 64bit hash of \str with seed \seed. The cached hash of \str is
+ * neither used nor updated.
+ */
+uint64_t cstr_hash_seed(const cstr *str, uint64_t seed)
+{
+	return hash64(CSTR_UINT8(str), CSTR_LEN(str), seed);
+}
+
+/*
+ * Hash string
+ * Returns the hash of \str with seed CSTR_HASH_SEED. The result is cached in
+ * \str so following calls return immediately until \str is modified.
+ * All functions that modify the string through cstr__fit() drop the cached
+ * hash. If you modify the buffer directly, you need to call
+ * cstr_hash_reset() yourself.
+ */
+uint64_t cstr_hash(cstr *str)
+{
+	if (!(str->flags & CSTR_F_HASHED)) {
+		str->hash = cstr_hash_seed(str, CSTR_HASH_SEED);
+		str->flags |= CSTR_F_HASHED;
+	}
+
+	return str->hash;
+}
@@ -0,0 +1,198 @@
+/*
+ * Static C-strings and arrays
+ * Written 2011 by David Herrmann
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * String Interning
+ * An intern table stores exactly one immutable copy of each distinct string.
+ * The table is split into CSTR_INTERN_SHARDS shards which are selected by the
+ * high bits of the string hash. Each shard has its own lock, its own open
+ * addressing hash table with linear probing and its own arena which the
+ * canonical strings are allocated from. Hence, threads that intern different
+ * strings rarely contend on the same lock.
+ * Each table entry caches the hash of its string so lookups only compare
+ * strings whose hashes match and growing a shard never rehashes any string.
+ * The canonical strings carry their hash, too, so comparing them against
+ * other strings with a cached hash is cheap.
+ */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cstr.h"
+#include "libcstr.h"
+
+#define SHARD_BITS 4
+#define SHARD_NUM (1 << SHARD_BITS)
+#define SHARD_MIN 64
+
+struct intern_entry {
+	uint64_t hash;
+	const cstr *str;
+};
+
+struct intern_shard {
+	pthread_mutex_t lock;
+	size_t num;
+	size_t size;
+	struct intern_entry *entries;
+	struct cstr_arena arena;
+};
+
+struct cstr_intern {
+	struct intern_shard shards[SHARD_NUM];
+};
+
+struct cstr_intern *cstr_intern_new(void)
+{
+	struct cstr_intern *table;
+	size_t i;
+
+	table = cstr__malloc(sizeof(*table));
+	if (!table)
+		return NULL;
+
+	for (i = 0; i < SHARD_NUM; ++i) {
+		pthread_mutex_init(&table->shards[i].lock, NULL);
+		table->shards[i].num = 0;
+		table->shards[i].size = 0;
+		table->shards[i].entries = NULL;
+		cstr_arena_init(&table->shards[i].arena, 0);
+	}
+
+	return table;
+}
+
+/*
+ * Free intern table
+ * This releases all strings of the table. Pointers returned by cstr_intern()
+ * are invalid afterwards.
+ */
+void cstr_intern_free(struct cstr_intern *table)
+{
+	size_t i;
+
+	if (!table)
+		return;
+
+	for (i = 0; i < SHARD_NUM; ++i) {
+		cstr_arena_destroy(&table->shards[i].arena);
+		cstr__free(table->shards[i].entries);
+		pthread_mutex_destroy(&table->shards[i].lock);
+	}
+
+	cstr__free(table);
+}
+
+/* double the size of \shard; returns false on memory allocation failure */
+static bool shard_grow(struct intern_shard *shard)
+{
+	struct intern_entry *entries;
+	size_t i, j, size, mask;
+
+	size = shard->size ? shard->size * 2 : SHARD_MIN;
+	mask = size - 1;
+
+	entries = cstr__malloc(size * sizeof(*entries));
+	if (!entries)
+		return false;
+	memset(entries, 0, size * sizeof(*entries));
+
+	for (i = 0; i < shard->size; ++i) {
+		if (!shard->entries[i].str)
+			continue;
+
+		j = shard->entries[i].hash & mask;
+		while (entries[j].str)
+			j = (j + 1) & mask;
+		entries[j] = shard->entries[i];
+	}
+
+	cstr__free(shard->entries);
+	shard->entries = entries;
+	shard->size = size;
+
+	return true;
+}
+
+/*
+ * Returns the slot of the entry equal to \str in \shard or of the empty slot
+ * where it belongs. \shard must not be empty.
+ */
+static size_t shard_find(struct intern_shard *shard, const cstr *str,
+								uint64_t hash)
+{
+	struct intern_entry *e;
+	size_t i, mask;
+
+	mask = shard->size - 1;
+	for (i = hash & mask; shard->entries[i].str; i = (i + 1) & mask) {
+		e = &shard->entries[i];
+		if (e->hash == hash && cstr_cmp(e->str, str))
+			break;
+	}
+
+	return i;
+}
+
+/*
+ * Intern string
+ * This returns the canonical copy of \str in \table. If \table does not
+ * contain a string equal to \str, yet, a constant copy of \str is added. The
+ * returned object is owned by the table and must not be modified or freed. It
+ * stays valid until the table is freed.
+ * Two strings interned in the same table are equal if and only if the returned
+ * pointers are equal, see cstr_intern_eq().
+ * This is thread-safe. Returns NULL on memory allocation failure.
+ */
+const cstr *cstr_intern(struct cstr_intern *table, const cstr *str)
+{
+	struct intern_shard *shard;
+	const cstr *res = NULL;
+	cstr *copy;
+	uint64_t hash;
+	size_t i = 0;
+
+	assert(table && str);
+
+	hash = cstr_chash(str);
+	shard = &table->shards[hash >> (64 - SHARD_BITS)];
+
+	pthread_mutex_lock(&shard->lock);
+
+	if (shard->size) {
+		i = shard_find(shard, str, hash);
+		if (shard->entries[i].str) {
+			res = shard->entries[i].str;
+			goto out;
+		}
+	}
+
+	/* keep the load factor below 3/4, only new strings need room */
+	if ((shard->num + 1) * 4 > shard->size * 3) {
+		if (!shard_grow(shard))
+			goto out;
+		i = shard_find(shard, str, hash);
+	}
+
+	copy = cstr_cadup(&shard->arena, str);
+	if (!copy)
+		goto out;
+
+	copy->hash = hash;
+	copy->flags |= CSTR_F_HASHED;
+	res = copy;
+
+	shard->entries[i].hash = hash;
+	shard->entries[i].str = res;
+	++shard->num;
+
+out:
+	pthread_mutex_unlock(&shard->lock);
+	return res;
+}
@@ -0,0 +1,210 @@
+/*
+ * Static C-strings and arrays
+ * Written 2011 by David Herrmann
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * File Descriptor I/O
+ * Strings are written with writev() so many strings cost a single syscall and
+ * no copy. Reading appends directly into the buffer of the string. The buffer
+ * is grown geometrically and rounded so the allocation is a multiple of the
+ * page size. Regular files are pre-sized with their file size.
+ * Both directions retry on EINTR and wait with poll() on EAGAIN, so they can
+ * be used on non-blocking file descriptors like blocking ones.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "cstr.h"
+#include "libcstr.h"
+
+/* maximum number of iovecs passed to a single writev() call */
+#if defined(IOV_MAX) && IOV_MAX < 1024
+	#define IOV_BATCH IOV_MAX
+#else
+	#define IOV_BATCH 1024
+#endif
+
+int cstr__wait_fd(int fd, short events)
+{
+	struct pollfd pfd = { .fd = fd, .events = events };
+
+	if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+		return -errno;
+
+	return 0;
+}
+
+/*
+ * Write strings
+ * Writes the strings \strs[0] to \strs[n - 1] to \fd in this order. The
+ * strings are passed in batches of iovecs to writev() and partial writes are
+ * continued until everything is written.
+ * Returns the number of bytes written or a negative error code. On error some
+ * of the strings may have been written already.
+ */
+ssize_t cstr_writev_fd(int fd, cstr **strs, size_t n)
+{
+	struct iovec iov[IOV_BATCH];
+	size_t i, num, off, rem, bytes;
+	ssize_t total, r;
+	int ret;
+
+	total = 0;
+	i = 0;
+	off = 0;
+	while (i < n) {
+		bytes = 0;
+		for (num = 0; num < IOV_BATCH && i + num < n; ++num) {
+			iov[num].iov_base = CSTR_UINT8(strs[i + num]);
+			iov[num].iov_len = CSTR_LEN(strs[i + num]);
+			bytes += iov[num].iov_len;
+		}
+		iov[0].iov_base = (uint8_t*)iov[0].iov_base + off;
+		iov[0].iov_len -= off;
+		bytes -= off;
+
+		r = writev(fd, iov, num);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				return -errno;
+			ret = cstr__wait_fd(fd, POLLOUT);
+			if (ret)
+				return ret;
+			continue;
+		}
+
+		if (!r && bytes)
+			return -EIO;
+
+		total += r;
+
+		/* skip everything that was written, including empty strings */
+		while (i < n) {
+			rem = CSTR_LEN(strs[i]) - off;
+			if ((size_t)r < rem)
+				break;
+			r -= rem;
+			off = 0;
+			++i;
+		}
+
+		if (i < n)
+			off += r;
+	}
+
+	return total;
+}
+
+/* makes room for at least \min bytes while preserving the string length */
+static bool reserve(cstr *str, size_t min)
+{
+	size_t len, size, page;
+
+	if (CSTR_SIZE(str) >= (ssize_t)min &&
+				!(str->flags & CSTR_F_RDONLY)) {
+		cstr_hash_reset(str);
+		return true;
+	}
+
+	len = str->len;
+	page = sysconf(_SC_PAGESIZE);
+
+	size = len * 2;
+	if (size < min)
+		size = min;
+	/* cstr__fit() allocates one more byte for the terminating zero */
+	size = ((size + page) & ~(page - 1)) - 1;
+
+	if (!cstr__fit(str, size, true))
+		return false;
+
+	str->len = len;
+	str->buf[len] = 0;
+
+	return true;
+}
+
+/*
+ * Read and append
+ * Reads \fd until end-of-file and appends everything to \str.
+ * Returns 0 on success or a negative error code. On error, the data that was
+ * read before the error occurred stays appended to \str.
+ */
+int cstr_read_append_fd(cstr *str, int fd)
+{
+	struct stat st;
+	size_t page, spare;
+	ssize_t r;
+	int ret;
+
+	page = sysconf(_SC_PAGESIZE);
+
+	/* read regular files in a single pass, +1 to detect end-of-file */
+	if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+		if (!reserve(str, str->len + st.st_size + 1))
+			return -ENOMEM;
+	}
+
+	while (1) {
+		spare = CSTR_SIZE(str) - str->len;
+		if (!spare || (str->flags & CSTR_F_RDONLY)) {
+			if (!reserve(str, str->len + page))
+				return -ENOMEM;
+			spare = CSTR_SIZE(str) - str->len;
+		}
+
+		cstr_hash_reset(str);
+		r = read(fd, str->buf + str->len, spare);
+		if (r < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				return -errno;
+			ret = cstr__wait_fd(fd, POLLIN);
+			if (ret)
+				return ret;
+			continue;
+		} else if (!r) {
+			return 0;
+		}
+
+		str->len += r;
+		str->buf[str->len] = 0;
+	}
+}
+
+/*
+ * Read file descriptor
+ * Reads \fd until end-of-file and returns a new object with the content.
+ * Returns NULL on failure and sets errno.
+ */
+cstr *cstr_read_fd(int fd)
+{
+	cstr *str;
+	int ret;
+
+	str = cstr_new(0);
+	if (!str)
+		return NULL;
+
+	ret = cstr_read_append_fd(str, fd);
+	if (ret) {
+		cstr_free(str);
+		errno = -ret;
+		return NULL;
+	}
+
+	return str;
+}
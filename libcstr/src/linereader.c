@@ -0,0 +1,241 @@
+/*
+ * Static C-strings and arrays
+ * Written 2011 by David Herrmann
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * Line Reader
+ * A line reader splits the content of a file descriptor into lines and returns
+ * them as views, so reading a line never allocates nor copies it.
+ * Regular files are mapped into memory with cstr_map_fd() and the lines point
+ * directly into the mapping. Files in procfs and sysfs are regular but report
+ * a size of zero, so only files with a known size are mapped. Other file
+ * descriptors and files that cannot be mapped are read into a single
+ * page-aligned buffer which is reused for the whole file. If a line is not
+ * complete, the unconsumed tail is moved to the front of the buffer and the
+ * buffer is refilled. Only lines longer than the buffer make it grow.
+ * Newlines are searched with the vectorized search kernels. \scan remembers
+ * how far the current line was already searched so refills do not search the
+ * same bytes again.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "cstr.h"
+#include "libcstr.h"
+
+static uint8_t *buf_alloc(size_t size)
+{
+	void *buf;
+
+	if (posix_memalign(&buf, sysconf(_SC_PAGESIZE), size))
+		return NULL;
+
+	return buf;
+}
+
+/*
+ * Initialize line reader
+ * Initializes \reader to read lines from \fd starting at its current offset.
+ * \size is the initial buffer size; 0 selects CSTR_LINEREADER_SIZE. It is
+ * rounded up to a multiple of the page size. Regular files with a non-zero
+ * size are mapped and do not use the buffer at all. If mapping fails, the file
+ * is read like any other file descriptor. \fd is not closed by the reader.
+ * Returns 0 on success or a negative error code.
+ */
+int cstr_linereader_init(struct cstr_linereader *reader, int fd, size_t size)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+	struct stat st;
+	off_t off;
+
+	memset(reader, 0, sizeof(*reader));
+	reader->fd = fd;
+
+	if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0)
+		reader->map = cstr_map_fd(fd);
+	if (reader->map) {
+		off = lseek(fd, 0, SEEK_CUR);
+		if (off < 0)
+			off = 0;
+		if ((size_t)off > reader->map->len)
+			off = reader->map->len;
+
+		reader->buf = reader->map->buf;
+		reader->pos = off;
+		reader->scan = off;
+		reader->end = reader->map->len;
+		reader->size = reader->map->len;
+		reader->eof = true;
+		return 0;
+	}
+
+	if (!size)
+		size = CSTR_LINEREADER_SIZE;
+	size = (size + page - 1) & ~(page - 1);
+
+	reader->buf = buf_alloc(size);
+	if (!reader->buf)
+		return -ENOMEM;
+	reader->size = size;
+
+	return 0;
+}
+
+void cstr_linereader_destroy(struct cstr_linereader *reader)
+{
+	if (reader->map)
+		cstr_unmap(reader->map);
+	else
+		free(reader->buf);
+
+	memset(reader, 0, sizeof(*reader));
+}
+
+/* makes room behind the unconsumed data, growing the buffer if it is full */
+static int make_room(struct cstr_linereader *reader)
+{
+	size_t len = reader->end - reader->pos;
+	uint8_t *buf;
+
+	if (reader->pos) {
+		memmove(reader->buf, reader->buf + reader->pos, len);
+		reader->scan -= reader->pos;
+		reader->pos = 0;
+		reader->end = len;
+	}
+
+	if (reader->end < reader->size)
+		return 0;
+
+	buf = buf_alloc(reader->size * 2);
+	if (!buf)
+		return -ENOMEM;
+
+	memcpy(buf, reader->buf, len);
+	free(reader->buf);
+	reader->buf = buf;
+	reader->size *= 2;
+
+	return 0;
+}
+
+/* reads more data into the buffer; returns 0 or a negative error code */
+static int refill(struct cstr_linereader *reader)
+{
+	ssize_t r;
+	int ret;
+
+	ret = make_room(reader);
+	if (ret)
+		return ret;
+
+	while (1) {
+		r = read(reader->fd, reader->buf + reader->end,
+						reader->size - reader->end);
+		if (r > 0) {
+			reader->end += r;
+			return 0;
+		} else if (!r) {
+			reader->eof = true;
+			return 0;
+		} else if (errno == EINTR) {
+			continue;
+		} else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+			return -errno;
+		}
+
+		ret = cstr__wait_fd(reader->fd, POLLIN);
+		if (ret)
+			return ret;
+	}
+}
+
+/*
+ * Searches the next complete line in the buffered data. The last line of the
+ * input is complete on end-of-file even without a trailing newline.
+ */
+static bool next_buffered(struct cstr_linereader *reader, cstr_view *line)
+{
+	const uint8_t *p;
+	size_t end;
+
+	p = NULL;
+	if (reader->scan < reader->end)
+		p = cstr__memchr(reader->buf + reader->scan,
+					reader->end - reader->scan, '\n');
+
+	if (p) {
+		end = p - reader->buf;
+	} else if (reader->eof && reader->pos < reader->end) {
+		end = reader->end;
+	} else {
+		reader->scan = reader->end;
+		return false;
+	}
+
+	line->buf = reader->buf + reader->pos;
+	line->len = end - reader->pos;
+	reader->pos = end + (end < reader->end);
+	reader->scan = reader->pos;
+
+	return true;
+}
+
+/*
+ * Read line
+ * Stores the next line of \reader in \line. The newline character is not part
+ * of the line. The view is valid until the reader is used again.
+ * Returns 1 if a line was read, 0 on end-of-file or a negative error code.
+ */
+int cstr_linereader_next(struct cstr_linereader *reader, cstr_view *line)
+{
+	int ret;
+
+	while (!next_buffered(reader, line)) {
+		if (reader->eof)
+			return 0;
+
+		ret = refill(reader);
+		if (ret)
+			return ret;
+	}
+
+	return 1;
+}
+
+/*
+ * Read lines
+ * Stores up to \num lines of \reader in \lines. This amortizes the call
+ * overhead for short lines. The buffer is refilled only if no line is
+ * available, so all returned views stay valid until the reader is used again.
+ * Returns the number of lines read, 0 on end-of-file or a negative error code.
+ */
+ssize_t cstr_linereader_batch(struct cstr_linereader *reader, cstr_view *lines,
+								size_t num)
+{
+	size_t i;
+	int ret;
+
+	if (!num)
+		return 0;
+
+	ret = cstr_linereader_next(reader, &lines[0]);
+	if (ret <= 0)
+		return ret;
+
+	for (i = 1; i < num; ++i) {
+		if (!next_buffered(reader, &lines[i]))
+			break;
+	}
+
+	return i;
+}
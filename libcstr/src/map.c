@@ -0,0 +1,359 @@
+/*
+ * Static C-strings and arrays
+ * Written 2011 by David Herrmann
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * Hash Maps
+ * This is an open addressing hash map in the style of the "Swiss tables". The
+ * slots are split into groups of 16. Each slot has a control byte which is
+ * either CTRL_EMPTY, CTRL_DELETED or, for used slots, the lower 7 bits of the
+ * key hash (h2). The remaining hash bits (h1) select the first group to probe.
+ * A lookup loads the 16 control bytes of a group at once and compares them
+ * against h2, so only slots with matching h2 are compared against the key.
+ * Probing stops at the first group with an empty slot. The groups are probed
+ * in triangular order which visits every group as the number of groups is a
+ * power of two.
+ * Erased slots are marked as deleted, unless their group contains an empty
+ * slot, in which case no probe sequence can pass through the group and the
+ * slot is marked empty directly.
+ * The map stays at most 7/8 full. \growth_left counts how many empty slots
+ * may still be used before the map is rehashed.
+ * Keys are stored as constant single-block copies with cached hash.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cstr.h"
+#include "libcstr.h"
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+
+#define GROUP 16
+#define CTRL_EMPTY ((uint8_t)0x80)
+#define CTRL_DELETED ((uint8_t)0xfe)
+
+static inline bool ctrl_full(uint8_t c)
+{
+	return !(c & 0x80);
+}
+
+static inline size_t h1(uint64_t hash)
+{
+	return hash >> 7;
+}
+
+static inline uint8_t h2(uint64_t hash)
+{
+	return hash & 0x7f;
+}
+
+/* bit-mask of all slots in the group at \ctrl with control byte \c */
+static inline unsigned int group_match(const uint8_t *ctrl, uint8_t c)
+{
+#if defined(__SSE2__)
+	__m128i g = _mm_load_si128((const __m128i*)ctrl);
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8(c)));
+#else
+	unsigned int i, m = 0;
+
+	for (i = 0; i < GROUP; ++i) {
+		if (ctrl[i] == c)
+			m |= 1U << i;
+	}
+
+	return m;
+#endif
+}
+
+/* bit-mask of all empty or deleted slots in the group at \ctrl */
+static inline unsigned int group_free(const uint8_t *ctrl)
+{
+#if defined(__SSE2__)
+	__m128i g = _mm_load_si128((const __m128i*)ctrl);
+
+	return _mm_movemask_epi8(g);
+#else
+	unsigned int i, m = 0;
+
+	for (i = 0; i < GROUP; ++i) {
+		if (!ctrl_full(ctrl[i]))
+			m |= 1U << i;
+	}
+
+	return m;
+#endif
+}
+
+void cstr_map_init(struct cstr_map *map)
+{
+	map->num = 0;
+	map->size = 0;
+	map->growth_left = 0;
+	map->ctrl = NULL;
+	map->slots = NULL;
+}
+
+void cstr_map_destroy(struct cstr_map *map)
+{
+	size_t i;
+
+	for (i = 0; i < map->size; ++i) {
+		if (ctrl_full(map->ctrl[i]))
+			cstr_free(map->slots[i].key);
+	}
+
+	free(map->ctrl);
+	cstr__free(map->slots);
+	cstr_map_init(map);
+}
+
+/* find the slot of \key or return -1 */
+static ssize_t map_lookup(const struct cstr_map *map, const cstr *key,
+								uint64_t hash)
+{
+	size_t g, i, gmask;
+	unsigned int m;
+	const cstr *k;
+
+	if (!map->size)
+		return -1;
+
+	gmask = map->size / GROUP - 1;
+	g = h1(hash) & gmask;
+
+	for (i = 1; ; ++i) {
+		m = group_match(&map->ctrl[g * GROUP], h2(hash));
+		while (m) {
+			k = map->slots[g * GROUP + __builtin_ctz(m)].key;
+			if (k->hash == hash && cstr_cmp(k, key))
+				return g * GROUP + __builtin_ctz(m);
+			m &= m - 1;
+		}
+
+		if (group_match(&map->ctrl[g * GROUP], CTRL_EMPTY))
+			return -1;
+
+		g = (g + i) & gmask;
+	}
+}
+
+/* find the first empty or deleted slot on the probe sequence of \hash */
+static size_t map_free_slot(const struct cstr_map *map, uint64_t hash)
+{
+	size_t g, i, gmask;
+	unsigned int m;
+
+	gmask = map->size / GROUP - 1;
+	g = h1(hash) & gmask;
+
+	for (i = 1; ; ++i) {
+		m = group_free(&map->ctrl[g * GROUP]);
+		if (m)
+			return g * GROUP + __builtin_ctz(m);
+
+		g = (g + i) & gmask;
+	}
+}
+
+/* rehash all entries into a table with \size slots */
+static bool map_rehash(struct cstr_map *map, size_t size)
+{
+	struct cstr_map_entry *slots, *old_slots = map->slots;
+	uint8_t *ctrl, *old_ctrl = map->ctrl;
+	size_t i, j, old_size = map->size;
+
+	assert(size >= GROUP && !(size & (size - 1)));
+
+	if (posix_memalign((void**)&ctrl, GROUP, size))
+		return false;
+
+	slots = cstr__malloc(size * sizeof(*slots));
+	if (!slots) {
+		free(ctrl);
+		return false;
+	}
+
+	memset(ctrl, CTRL_EMPTY, size);
+
+	map->ctrl = ctrl;
+	map->slots = slots;
+	map->size = size;
+	map->growth_left = size - size / 8 - map->num;
+
+	for (i = 0; i < old_size; ++i) {
+		if (!ctrl_full(old_ctrl[i]))
+			continue;
+
+		j = map_free_slot(map, old_slots[i].key->hash);
+		ctrl[j] = old_ctrl[i];
+		slots[j] = old_slots[i];
+	}
+
+	free(old_ctrl);
+	cstr__free(old_slots);
+
+	return true;
+}
+
+/*
+ * Make room for new entries. If many slots are only marked as deleted, the map
+ * is rehashed with the same size to drop them. Otherwise the size is doubled.
+ */
+static bool map_grow(struct cstr_map *map)
+{
+	if (!map->size)
+		return map_rehash(map, GROUP);
+	if (map->num < (map->size - map->size / 8) / 2)
+		return map_rehash(map, map->size);
+	return map_rehash(map, map->size * 2);
+}
+
+/*
+ * Reserve space
+ * This makes \map big enough to hold \num entries without rehashing. This
+ * should be used before inserting many entries at once.
+ * Returns false on memory allocation failure.
+ */
+bool cstr_map_reserve(struct cstr_map *map, size_t num)
+{
+	size_t size = GROUP;
+
+	while (size - size / 8 < num)
+		size *= 2;
+
+	if (size <= map->size)
+		return true;
+
+	return map_rehash(map, size);
+}
+
+/*
+ * Insert entry
+ * This maps \key to \value. If \key is already in \map, its value is replaced.
+ * Otherwise, a copy of \key is stored in the map.
+ * Returns false on memory allocation failure.
+ */
+bool cstr_map_insert(struct cstr_map *map, const cstr *key, void *value)
+{
+	uint64_t hash = cstr_chash(key);
+	ssize_t pos;
+	size_t i;
+	cstr *k;
+
+	pos = map_lookup(map, key, hash);
+	if (pos >= 0) {
+		map->slots[pos].value = value;
+		return true;
+	}
+
+	k = cstr_cidup(key);
+	if (!k)
+		return false;
+
+	k->hash = hash;
+	k->flags |= CSTR_F_HASHED;
+
+	i = map->size ? map_free_slot(map, hash) : 0;
+	if (!map->size || (map->ctrl[i] == CTRL_EMPTY && !map->growth_left)) {
+		if (!map_grow(map)) {
+			cstr_free(k);
+			return false;
+		}
+		i = map_free_slot(map, hash);
+	}
+
+	if (map->ctrl[i] == CTRL_EMPTY)
+		--map->growth_left;
+
+	map->ctrl[i] = h2(hash);
+	map->slots[i].key = k;
+	map->slots[i].value = value;
+	++map->num;
+
+	return true;
+}
+
+/*
+ * Find entry
+ * Returns a pointer to the value of \key or NULL if \key is not in \map. The
+ * pointer is valid until the map is modified. \key may be a borrowed object
+ * like CSTR_CB() so no allocation is needed for lookups.
+ */
+void **cstr_map_find(const struct cstr_map *map, const cstr *key)
+{
+	ssize_t pos;
+
+	pos = map_lookup(map, key, cstr_chash(key));
+	if (pos < 0)
+		return NULL;
+
+	return &map->slots[pos].value;
+}
+
+/*
+ * Find entry by raw key
+ * Like cstr_map_find() but takes the key as buffer \key of length \len.
+ */
+void **cstr_map_findn(const struct cstr_map *map, const void *key, size_t len)
+{
+	return cstr_map_find(map, CSTR_CB(len, key));
+}
+
+/*
+ * Erase entry
+ * Removes \key from \map. If \value is non-NULL, the value of the erased entry
+ * is stored in it.
+ * Returns false if \key was not in \map.
+ */
+bool cstr_map_erase(struct cstr_map *map, const cstr *key, void **value)
+{
+	ssize_t pos;
+
+	pos = map_lookup(map, key, cstr_chash(key));
+	if (pos < 0)
+		return false;
+
+	if (value)
+		*value = map->slots[pos].value;
+	cstr_free(map->slots[pos].key);
+
+	if (group_match(&map->ctrl[pos & ~(ssize_t)(GROUP - 1)], CTRL_EMPTY)) {
+		map->ctrl[pos] = CTRL_EMPTY;
+		++map->growth_left;
+	} else {
+		map->ctrl[pos] = CTRL_DELETED;
+	}
+
+	--map->num;
+	return true;
+}
+
+/*
+ * Iterate entries
+ * Returns the next entry of \map starting at position *\iter and advances
+ * *\iter behind it. Returns NULL if there are no more entries. *\iter must be
+ * initialized to 0. The order of entries is unspecified. The map must not be
+ * modified during iteration except for the values of the entries.
+ */
+struct cstr_map_entry *cstr_map_next(const struct cstr_map *map, size_t *iter)
+{
+	size_t i;
+
+	for (i = *iter; i < map->size; ++i) {
+		if (ctrl_full(map->ctrl[i])) {
+			*iter = i + 1;
+			return &map->slots[i];
+		}
+	}
+
+	*iter = map->size;
+	return NULL;
+}
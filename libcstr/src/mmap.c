@@ -0,0 +1,136 @@
+/*
+ * Static C-strings and arrays
+ * Written 2011 by David Herrmann
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * Memory Mapped Files
+ * A file can be mapped read-only into memory and used as buffer of a cstr
+ * object without reading it. Such objects have CSTR_F_MMAP set and a negative
+ * size, as we cannot resize the mapping. Like shared buffers, cstr__fit()
+ * always copies a mapped string into a private buffer and unmaps the file.
+ * Every cstr buffer must be terminated by a zero character. If the file size
+ * is a multiple of the page size, there is no room for it in the file mapping.
+ * Therefore, we first reserve an anonymous mapping which is one byte bigger
+ * than the file and then map the file over it. The remaining bytes of the
+ * anonymous mapping are zero.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "cstr.h"
+#include "libcstr.h"
+
+/* systems without "CLOEXEC" should just ignore it */
+#ifndef O_CLOEXEC
+	#define O_CLOEXEC 0
+#endif
+
+/* size of the mapping of a file with \len bytes */
+static size_t map_size(size_t len)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+
+	return (len + page) & ~(page - 1);
+}
+
+void cstr__mmap_release(cstr *str)
+{
+	assert(str->flags & CSTR_F_MMAP);
+
+	munmap(str->buf, map_size(CSTR_SIZE(str)));
+}
+
+/*
+ * Map file descriptor
+ * This maps the whole regular file \fd read-only into memory and returns a
+ * cstr object with the file content as buffer. The file is not read. \fd may
+ * be closed afterwards. The mapping is released with cstr_unmap() or
+ * cstr_free(). Modifying the object copies the content into a private buffer.
+ * The buffer must not be modified directly. The content is undefined if the
+ * file is truncated or modified while it is mapped.
+ * The kernel is advised that the file will be read sequentially and soon.
+ * Empty files fail with ENODEV like other files that cannot be mapped, as
+ * procfs and sysfs files report a size of zero although they have content.
+ * Callers should read() such files instead.
+ * Returns NULL on failure and sets errno.
+ */
+cstr *cstr_map_fd(int fd)
+{
+	struct stat st;
+	size_t size;
+	void *buf;
+	cstr *str;
+	int err;
+
+	if (fstat(fd, &st))
+		return NULL;
+	if (!S_ISREG(st.st_mode) || !st.st_size) {
+		errno = ENODEV;
+		return NULL;
+	}
+
+	size = map_size(st.st_size);
+	buf = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buf == MAP_FAILED)
+		return NULL;
+
+	if (mmap(buf, st.st_size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) ==
+								MAP_FAILED) {
+		err = errno;
+		goto err_unmap;
+	}
+
+	madvise(buf, st.st_size, MADV_SEQUENTIAL);
+	madvise(buf, st.st_size, MADV_WILLNEED);
+
+	str = cstr__malloc(sizeof(*str));
+	if (!str) {
+		err = ENOMEM;
+		goto err_unmap;
+	}
+
+	str->len = st.st_size;
+	str->size = -(ssize_t)st.st_size;
+	str->buf = buf;
+	str->flags = CSTR_F_MMAP;
+	str->arena = NULL;
+
+	return str;
+
+err_unmap:
+	munmap(buf, size);
+	errno = err;
+	return NULL;
+}
+
+/*
+ * Map file
+ * Like cstr_map_fd() but opens the file at \path.
+ * Returns NULL on failure and sets errno.
+ */
+cstr *cstr_map_file(const cstr *path)
+{
+	cstr *str;
+	int fd, err;
+
+	fd = open(CSTR_CHAR(path), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	str = cstr_map_fd(fd);
+	err = errno;
+	close(fd);
+	errno = err;
+
+	return str;
+}
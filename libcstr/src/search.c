@@ -0,0 +1,402 @@
+/*
+ * Static C-strings and arrays
+ * Written 2011 by David Herrmann
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * Searching
+ * All search functions are binary safe, that is, they work on strings with
+ * embedded zero characters. The kernels operate on (pointer, length) pairs so
+ * other modules can use them on raw buffers, too.
+ * On x86-64 there are SSE2 and AVX2 kernels. SSE2 is always available on
+ * x86-64, AVX2 is detected at runtime on first use. Other architectures use
+ * the scalar kernels.
+ * The vector kernels compare 16 or 32 bytes at once and use the resulting
+ * bit-mask to locate the match. Substring search compares the first and the
+ * last byte of the needle at each position in parallel and verifies the
+ * remaining bytes only for positions where both match.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cstr.h"
+#include "libcstr.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+	#define SEARCH_SIMD 1
+	#include <immintrin.h>
+#endif
+
+struct search_ops {
+	const uint8_t *(*chr) (const uint8_t *s, size_t n, uint8_t c);
+	const uint8_t *(*rchr) (const uint8_t *s, size_t n, uint8_t c);
+	const uint8_t *(*find) (const uint8_t *s, size_t n,
+						const uint8_t *needle, size_t k);
+	const uint8_t *(*find_any) (const uint8_t *s, size_t n,
+						const uint8_t *set, size_t k);
+};
+
+/*
+ * Scalar kernels
+ * These are used as fallback and to handle the tails of the vector kernels.
+ */
+
+static const uint8_t *chr_scalar(const uint8_t *s, size_t n, uint8_t c)
+{
+	return memchr(s, c, n);
+}
+
+static const uint8_t *rchr_scalar(const uint8_t *s, size_t n, uint8_t c)
+{
+	while (n--) {
+		if (s[n] == c)
+			return &s[n];
+	}
+
+	return NULL;
+}
+
+static const uint8_t *find_scalar(const uint8_t *s, size_t n,
+					const uint8_t *needle, size_t k)
+{
+	const uint8_t *end, *p;
+
+	if (!k)
+		return s;
+	if (k > n)
+		return NULL;
+
+	end = s + n - k + 1;
+	while ((p = memchr(s, needle[0], end - s))) {
+		if (!memcmp(p + 1, needle + 1, k - 1))
+			return p;
+		s = p + 1;
+	}
+
+	return NULL;
+}
+
+static const uint8_t *find_any_scalar(const uint8_t *s, size_t n,
+					const uint8_t *set, size_t k)
+{
+	uint64_t map[4] = { 0 };
+	size_t i;
+
+	for (i = 0; i < k; ++i)
+		map[set[i] >> 6] |= 1ULL << (set[i] & 63);
+
+	for (i = 0; i < n; ++i) {
+		if (map[s[i] >> 6] & (1ULL << (s[i] & 63)))
+			return &s[i];
+	}
+
+	return NULL;
+}
+
+static const struct search_ops ops_scalar = {
+	.chr = chr_scalar,
+	.rchr = rchr_scalar,
+	.find = find_scalar,
+	.find_any = find_any_scalar,
+};
+
+#ifdef SEARCH_SIMD
+
+/* maximal set size that is handled by the vector kernels */
+#define SET_MAX 16
+
+/*
+ * SSE2 kernels
+ */
+
+static const uint8_t *chr_sse2(const uint8_t *s, size_t n, uint8_t c)
+{
+	const __m128i v = _mm_set1_epi8(c);
+	__m128i b;
+	unsigned int m;
+	size_t i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		b = _mm_loadu_si128((const __m128i*)&s[i]);
+		m = _mm_movemask_epi8(_mm_cmpeq_epi8(b, v));
+		if (m)
+			return &s[i + __builtin_ctz(m)];
+	}
+
+	return chr_scalar(&s[i], n - i, c);
+}
+
+static const uint8_t *rchr_sse2(const uint8_t *s, size_t n, uint8_t c)
+{
+	const __m128i v = _mm_set1_epi8(c);
+	__m128i b;
+	unsigned int m;
+
+	for ( ; n >= 16; n -= 16) {
+		b = _mm_loadu_si128((const __m128i*)&s[n - 16]);
+		m = _mm_movemask_epi8(_mm_cmpeq_epi8(b, v));
+		if (m)
+			return &s[n - 16 + 31 - __builtin_clz(m)];
+	}
+
+	return rchr_scalar(s, n, c);
+}
+
+static const uint8_t *find_sse2(const uint8_t *s, size_t n,
+					const uint8_t *needle, size_t k)
+{
+	__m128i first, last, bf, bl;
+	unsigned int m;
+	size_t i, b;
+
+	if (k < 2)
+		return k ? chr_sse2(s, n, needle[0]) : s;
+
+	first = _mm_set1_epi8(needle[0]);
+	last = _mm_set1_epi8(needle[k - 1]);
+
+	for (i = 0; i + k + 15 <= n; i += 16) {
+		bf = _mm_loadu_si128((const __m128i*)&s[i]);
+		bl = _mm_loadu_si128((const __m128i*)&s[i + k - 1]);
+		m = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(bf, first),
+						_mm_cmpeq_epi8(bl, last)));
+		while (m) {
+			b = __builtin_ctz(m);
+			if (!memcmp(&s[i + b + 1], needle + 1, k - 2))
+				return &s[i + b];
+			m &= m - 1;
+		}
+	}
+
+	return find_scalar(&s[i], n - i, needle, k);
+}
+
+static const uint8_t *find_any_sse2(const uint8_t *s, size_t n,
+					const uint8_t *set, size_t k)
+{
+	__m128i v[SET_MAX], b, r;
+	unsigned int m;
+	size_t i, j;
+
+	if (k > SET_MAX)
+		return find_any_scalar(s, n, set, k);
+
+	for (j = 0; j < k; ++j)
+		v[j] = _mm_set1_epi8(set[j]);
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		b = _mm_loadu_si128((const __m128i*)&s[i]);
+		r = _mm_setzero_si128();
+		for (j = 0; j < k; ++j)
+			r = _mm_or_si128(r, _mm_cmpeq_epi8(b, v[j]));
+		m = _mm_movemask_epi8(r);
+		if (m)
+			return &s[i + __builtin_ctz(m)];
+	}
+
+	return find_any_scalar(&s[i], n - i, set, k);
+}
+
+static const struct search_ops ops_sse2 = {
+	.chr = chr_sse2,
+	.rchr = rchr_sse2,
+	.find = find_sse2,
+	.find_any = find_any_sse2,
+};
+
+/*
+ * AVX2 kernels
+ * These handle the tails with the SSE2 kernels.
+ */
+
+__attribute__((target("avx2")))
+static const uint8_t *chr_avx2(const uint8_t *s, size_t n, uint8_t c)
+{
+	const __m256i v = _mm256_set1_epi8(c);
+	__m256i b;
+	unsigned int m;
+	size_t i;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		b = _mm256_loadu_si256((const __m256i*)&s[i]);
+		m = _mm256_movemask_epi8(_mm256_cmpeq_epi8(b, v));
+		if (m)
+			return &s[i + __builtin_ctz(m)];
+	}
+
+	return chr_sse2(&s[i], n - i, c);
+}
+
+__attribute__((target("avx2")))
+static const uint8_t *rchr_avx2(const uint8_t *s, size_t n, uint8_t c)
+{
+	const __m256i v = _mm256_set1_epi8(c);
+	__m256i b;
+	unsigned int m;
+
+	for ( ; n >= 32; n -= 32) {
+		b = _mm256_loadu_si256((const __m256i*)&s[n - 32]);
+		m = _mm256_movemask_epi8(_mm256_cmpeq_epi8(b, v));
+		if (m)
+			return &s[n - 32 + 31 - __builtin_clz(m)];
+	}
+
+	return rchr_sse2(s, n, c);
+}
+
+__attribute__((target("avx2")))
+static const uint8_t *find_avx2(const uint8_t *s, size_t n,
+					const uint8_t *needle, size_t k)
+{
+	__m256i first, last, bf, bl;
+	unsigned int m;
+	size_t i, b;
+
+	if (k < 2)
+		return k ? chr_avx2(s, n, needle[0]) : s;
+
+	first = _mm256_set1_epi8(needle[0]);
+	last = _mm256_set1_epi8(needle[k - 1]);
+
+	for (i = 0; i + k + 31 <= n; i += 32) {
+		bf = _mm256_loadu_si256((const __m256i*)&s[i]);
+		bl = _mm256_loadu_si256((const __m256i*)&s[i + k - 1]);
+		m = _mm256_movemask_epi8(_mm256_and_si256(
+						_mm256_cmpeq_epi8(bf, first),
+						_mm256_cmpeq_epi8(bl, last)));
+		while (m) {
+			b = __builtin_ctz(m);
+			if (!memcmp(&s[i + b + 1], needle + 1, k - 2))
+				return &s[i + b];
+			m &= m - 1;
+		}
+	}
+
+	return find_sse2(&s[i], n - i, needle, k);
+}
+
+__attribute__((target("avx2")))
+static const uint8_t *find_any_avx2(const uint8_t *s, size_t n,
+					const uint8_t *set, size_t k)
+{
+	__m256i v[SET_MAX], b, r;
+	unsigned int m;
+	size_t i, j;
+
+	if (k > SET_MAX)
+		return find_any_scalar(s, n, set, k);
+
+	for (j = 0; j < k; ++j)
+		v[j] = _mm256_set1_epi8(set[j]);
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		b = _mm256_loadu_si256((const __m256i*)&s[i]);
+		r = _mm256_setzero_si256();
+		for (j = 0; j < k; ++j)
+			r = _mm256_or_si256(r, _mm256_cmpeq_epi8(b, v[j]));
+		m = _mm256_movemask_epi8(r);
+		if (m)
+			return &s[i + __builtin_ctz(m)];
+	}
+
+	return find_any_sse2(&s[i], n - i, set, k);
+}
+
+static const struct search_ops ops_avx2 = {
+	.chr = chr_avx2,
+	.rchr = rchr_avx2,
+	.find = find_avx2,
+	.find_any = find_any_avx2,
+};
+
+#endif /* SEARCH_SIMD */
+
+/* select the kernels for this CPU, see cpu.c */
+static const struct search_ops *search_ops(void)
+{
+#ifdef SEARCH_SIMD
+	unsigned int isa = cstr__isa();
+
+	if (isa >= CSTR__ISA_AVX2)
+		return &ops_avx2;
+	if (isa >= CSTR__ISA_SSE2)
+		return &ops_sse2;
+#endif
+
+	return &ops_scalar;
+}
+
+const uint8_t *cstr__memchr(const uint8_t *s, size_t n, uint8_t c)
+{
+	return search_ops()->chr(s, n, c);
+}
+
+const uint8_t *cstr__memrchr(const uint8_t *s, size_t n, uint8_t c)
+{
+	return search_ops()->rchr(s, n, c);
+}
+
+const uint8_t *cstr__memmem(const uint8_t *s, size_t n,
+					const uint8_t *needle, size_t k)
+{
+	return search_ops()->find(s, n, needle, k);
+}
+
+const uint8_t *cstr__memchr_any(const uint8_t *s, size_t n,
+					const uint8_t *set, size_t k)
+{
+	return search_ops()->find_any(s, n, set, k);
+}
+
+static inline ssize_t offset(const cstr *str, const uint8_t *p)
+{
+	return p ? p - CSTR_UINT8(str) : -1;
+}
+
+/*
+ * Search character
+ * Returns the position of the first occurrence of \c in \str or -1 if \str
+ * does not contain \c.
+ */
+ssize_t cstr_chr(const cstr *str, uint8_t c)
+{
+	return offset(str, cstr__memchr(CSTR_UINT8(str), CSTR_LEN(str), c));
+}
+
+/*
+ * Search character backwards
+ * Returns the position of the last occurrence of \c in \str or -1 if \str does
+ * not contain \c.
+ */
+ssize_t cstr_rchr(const cstr *str, uint8_t c)
+{
+	return offset(str, cstr__memrchr(CSTR_UINT8(str), CSTR_LEN(str), c));
+}
+
+/*
+ * Search substring
+ * Returns the position of the first occurrence of \needle in \str or -1 if
+ * \str does not contain \needle. An empty \needle is found at position 0.
+ */
+ssize_t cstr_find(const cstr *str, const cstr *needle)
+{
+	return offset(str, cstr__memmem(CSTR_UINT8(str), CSTR_LEN(str),
+				CSTR_UINT8(needle), CSTR_LEN(needle)));
+}
+
+/*
+ * Search any character of a set
+ * Returns the position of the first character in \str which is also contained
+ * in \set or -1 if there is none. The characters in \set are taken as byte-set
+ * so their order does not matter. Sets of up to 16 characters are searched
+ * with the vector kernels.
+ */
+ssize_t cstr_find_any(const cstr *str, const cstr *set)
+{
+	return offset(str, cstr__memchr_any(CSTR_UINT8(str), CSTR_LEN(str),
+				CSTR_UINT8(set), CSTR_LEN(set)));
+}
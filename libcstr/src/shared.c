@@ -0,0 +1,145 @@
+/*
+ * Static C-strings and arrays
+ * Written 2011 by David Herrmann
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * Shared Buffers
+ * A shared buffer is a reference counted, immutable buffer that can be used
+ * by many cstr objects at once. The reference count is stored in front of the
+ * string data in the same allocation. Objects using a shared buffer have
+ * CSTR_F_SHARED set and a negative size as they do not own the buffer on
+ * their own. Duplicating such an object only allocates a new header and
+ * increases the reference count.
+ * The first modification through cstr__fit() copies the string into a private
+ * buffer and drops the reference (copy-on-write). The reference count is
+ * modified atomically so objects sharing a buffer can be passed to and freed
+ * in different threads.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cstr.h"
+#include "libcstr.h"
+
+struct shared_buf {
+	unsigned long ref;
+	uint8_t data[];
+};
+
+static inline struct shared_buf *to_shared(uint8_t *buf)
+{
+	return (struct shared_buf*)(buf - offsetof(struct shared_buf, data));
+}
+
+void cstr__shared_unref(uint8_t *buf)
+{
+	struct shared_buf *sb = to_shared(buf);
+
+	if (__atomic_sub_fetch(&sb->ref, 1, __ATOMIC_ACQ_REL) == 0)
+		cstr__free(sb);
+}
+
+cstr *cstr__shared_dup(const cstr *old)
+{
+	cstr *str;
+
+	assert(old->flags & CSTR_F_SHARED);
+
+	str = cstr__malloc(sizeof(*str));
+	if (!str)
+		return NULL;
+
+	__atomic_add_fetch(&to_shared(old->buf)->ref, 1, __ATOMIC_RELAXED);
+
+	*str = *old;
+	str->flags &= CSTR_F_SHARED | CSTR_F_HASHED;
+	return str;
+}
+
+/* copy \len bytes at \src into a new shared buffer */
+static uint8_t *shared_new(const uint8_t *src, size_t len)
+{
+	struct shared_buf *sb;
+
+	sb = cstr__malloc(sizeof(*sb) + len + 1);
+	if (!sb)
+		return NULL;
+
+	sb->ref = 1;
+	memcpy(sb->data, src, len);
+	sb->data[len] = 0;
+
+	return sb->data;
+}
+
+/*
+ * Share string buffer
+ * This moves the content of \str into a new shared buffer so following
+ * duplicates of \str do not copy the string. If \str already uses a shared
+ * buffer, nothing is done. The buffer of \str must not be modified directly
+ * afterwards. Use cstr_unshare() to get a private buffer again.
+ * Mapped files are copied into the new shared buffer and unmapped.
+ * This must not be used on arena objects.
+ * Returns false on memory allocation failure, in which case \str is left
+ * untouched.
+ */
+bool cstr_share(cstr *str)
+{
+	uint8_t *buf;
+
+	assert(!(str->flags & CSTR_F_ARENA));
+
+	if (str->flags & CSTR_F_SHARED)
+		return true;
+
+	buf = shared_new(CSTR_UINT8(str), CSTR_LEN(str));
+	if (!buf)
+		return false;
+
+	if (str->flags & CSTR_F_MMAP)
+		cstr__mmap_release(str);
+	else if (str->size >= 0 && !(str->flags & CSTR_F_INLINE))
+		cstr__free(str->buf);
+
+	str->buf = buf;
+	str->size = -(ssize_t)CSTR_LEN(str);
+	str->flags &= ~(CSTR_F_INLINE | CSTR_F_MMAP);
+	str->flags |= CSTR_F_SHARED;
+
+	return true;
+}
+
+/*
+ * Duplicate string into shared buffer
+ * Returns a new object that shares its buffer with \old if \old uses a shared
+ * buffer. Otherwise, a new shared buffer is created for the duplicate, so only
+ * following duplicates of the new object are free of copies.
+ * Returns NULL on memory allocation failure.
+ */
+cstr *cstr_sdup(const cstr *old)
+{
+	cstr *str;
+	uint8_t *buf;
+
+	if (old->flags & CSTR_F_SHARED)
+		return cstr__shared_dup(old);
+
+	buf = shared_new(CSTR_UINT8(old), CSTR_LEN(old));
+	if (!buf)
+		return NULL;
+
+	str = cstr_alloc(CSTR_LEN(old), -(ssize_t)CSTR_LEN(old), buf);
+	if (!str) {
+		cstr__shared_unref(buf);
+		return NULL;
+	}
+
+	str->flags |= CSTR_F_SHARED;
+	return str;
+}
@@ -0,0 +1,396 @@
+/*
+ * Static C-strings and arrays
+ * Written 2011 by David Herrmann
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * Ordering and Sorting
+ * Strings are ordered byte-wise like memcmp() and a string is ordered before
+ * all longer strings it is a prefix of. This is binary safe.
+ *
+ * cstr_sort() is a multikey quicksort. Instead of a single character it
+ * partitions by 8 byte chunks of the strings which are cached next to the
+ * string pointers as big-endian integers, so most comparisons never touch the
+ * string buffers. Short strings are padded with zeros. To distinguish padding
+ * from real zero bytes, every chunk is compared together with the number of
+ * string bytes it contains. If two chunks are equal and contain less than 8
+ * bytes, both strings end there and are equal. Only elements that are equal
+ * in the current chunk proceed to the next chunk.
+ *
+ * cstr_sort_parallel() splits the array into one part per thread, sorts the
+ * parts concurrently and merges them pairwise, again in parallel.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "cstr.h"
+#include "libcstr.h"
+
+/* arrays smaller than this are sorted by insertion sort */
+#define SORT_SMALL 16
+/* arrays smaller than this are not sorted in parallel */
+#define SORT_PARALLEL_MIN (64 * 1024)
+
+struct sort_entry {
+	uint64_t key;
+	unsigned int avail;
+	cstr *str;
+};
+
+/*
+ * Three-way comparison
+ * Returns a negative value if \str1 is ordered before \str2, zero if they are
+ * equal and a positive value otherwise.
+ */
+int cstr_order(const cstr *str1, const cstr *str2)
+{
+	size_t len;
+	int r;
+
+	if (str1 == str2)
+		return 0;
+
+	len = CSTR_LEN(str1) < CSTR_LEN(str2) ? CSTR_LEN(str1) : CSTR_LEN(str2);
+	r = memcmp(CSTR_VOID(str1), CSTR_VOID(str2), len);
+	if (r)
+		return r;
+
+	return (CSTR_LEN(str1) > CSTR_LEN(str2)) -
+					(CSTR_LEN(str1) < CSTR_LEN(str2));
+}
+
+/* loads the chunk of \e->str at \depth */
+static inline void load_key(struct sort_entry *e, size_t depth)
+{
+	size_t len = CSTR_LEN(e->str);
+	uint8_t b[8];
+	uint64_t key;
+
+	if (len >= depth + 8) {
+		memcpy(&key, CSTR_UINT8(e->str) + depth, 8);
+		e->avail = 8;
+	} else {
+		memset(b, 0, sizeof(b));
+		e->avail = len > depth ? len - depth : 0;
+		memcpy(b, CSTR_UINT8(e->str) + depth, e->avail);
+		memcpy(&key, b, 8);
+	}
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	key = __builtin_bswap64(key);
+#endif
+	e->key = key;
+}
+
+static inline int cmp_key(const struct sort_entry *e1,
+						const struct sort_entry *e2)
+{
+	if (e1->key != e2->key)
+		return e1->key < e2->key ? -1 : 1;
+
+	return (e1->avail > e2->avail) - (e1->avail < e2->avail);
+}
+
+/* compares two entries whose strings are equal up to \depth */
+static int cmp_entry(const struct sort_entry *e1, const struct sort_entry *e2,
+								size_t depth)
+{
+	const cstr *s1 = e1->str, *s2 = e2->str;
+	int r;
+
+	r = cmp_key(e1, e2);
+	if (r || e1->avail < 8)
+		return r;
+
+	depth += 8;
+	return cstr_order(CSTR_CB(CSTR_LEN(s1) - depth, CSTR_UINT8(s1) + depth),
+			CSTR_CB(CSTR_LEN(s2) - depth, CSTR_UINT8(s2) + depth));
+}
+
+static void insertion_sort(struct sort_entry *e, size_t n, size_t depth)
+{
+	struct sort_entry t;
+	size_t i, j;
+
+	for (i = 1; i < n; ++i) {
+		t = e[i];
+		for (j = i; j > 0 && cmp_entry(&t, &e[j - 1], depth) < 0; --j)
+			e[j] = e[j - 1];
+		e[j] = t;
+	}
+}
+
+static inline void swap(struct sort_entry *e1, struct sort_entry *e2)
+{
+	struct sort_entry t = *e1;
+
+	*e1 = *e2;
+	*e2 = t;
+}
+
+static const struct sort_entry *median3(const struct sort_entry *e1,
+					const struct sort_entry *e2,
+					const struct sort_entry *e3)
+{
+	if (cmp_key(e1, e2) < 0) {
+		if (cmp_key(e2, e3) < 0)
+			return e2;
+		return cmp_key(e1, e3) < 0 ? e3 : e1;
+	} else {
+		if (cmp_key(e1, e3) < 0)
+			return e1;
+		return cmp_key(e2, e3) < 0 ? e3 : e2;
+	}
+}
+
+static void mkqs(struct sort_entry *e, size_t n, size_t depth);
+
+/* sorts \n entries that are equal up to \depth + 8 by the following chunks */
+static void mkqs_next(struct sort_entry *e, size_t n, size_t depth)
+{
+	size_t i;
+
+	depth += 8;
+	for (i = 0; i < n; ++i)
+		load_key(&e[i], depth);
+
+	mkqs(e, n, depth);
+}
+
+/*
+ * Sorts \n entries whose strings are equal up to \depth and chunk is loaded.
+ * Only the two smaller partitions are sorted recursively and the loop
+ * continues with the biggest one, so the recursion depth is bounded by log2(n)
+ * even if the pivots are bad.
+ */
+static void mkqs(struct sort_entry *e, size_t n, size_t depth)
+{
+	struct sort_entry pivot;
+	size_t lt, gt, eq, i;
+	int r;
+
+	while (n >= SORT_SMALL) {
+		pivot = *median3(&e[0], &e[n / 2], &e[n - 1]);
+
+		lt = 0;
+		gt = n;
+		i = 0;
+		while (i < gt) {
+			r = cmp_key(&e[i], &pivot);
+			if (r < 0)
+				swap(&e[lt++], &e[i++]);
+			else if (r > 0)
+				swap(&e[i], &e[--gt]);
+			else
+				++i;
+		}
+
+		/* equal strings that end in this chunk are done */
+		eq = pivot.avail < 8 ? 0 : gt - lt;
+
+		if (eq >= lt && eq >= n - gt) {
+			mkqs(e, lt, depth);
+			mkqs(&e[gt], n - gt, depth);
+
+			e += lt;
+			n = eq;
+			depth += 8;
+			for (i = 0; i < n; ++i)
+				load_key(&e[i], depth);
+		} else if (lt >= n - gt) {
+			mkqs_next(&e[lt], eq, depth);
+			mkqs(&e[gt], n - gt, depth);
+			n = lt;
+		} else {
+			mkqs(e, lt, depth);
+			mkqs_next(&e[lt], eq, depth);
+			e += gt;
+			n -= gt;
+		}
+	}
+
+	insertion_sort(e, n, depth);
+}
+
+static int order_ptr(const void *p1, const void *p2)
+{
+	return cstr_order(*(cstr* const*)p1, *(cstr* const*)p2);
+}
+
+/* sorts \strs with cached chunks */
+static void sort_range(cstr **strs, size_t n)
+{
+	struct sort_entry *e;
+	size_t i;
+
+	e = cstr__malloc(n * sizeof(*e));
+	if (!e) {
+		qsort(strs, n, sizeof(*strs), order_ptr);
+		return;
+	}
+
+	for (i = 0; i < n; ++i) {
+		e[i].str = strs[i];
+		load_key(&e[i], 0);
+	}
+
+	mkqs(e, n, 0);
+
+	for (i = 0; i < n; ++i)
+		strs[i] = e[i].str;
+
+	cstr__free(e);
+}
+
+/*
+ * Sort array
+ * Sorts the \n strings in \strs in ascending order as defined by
+ * cstr_order(). The sort is not stable. It needs \n * 24 bytes of temporary
+ * memory. If that cannot be allocated, qsort() is used instead.
+ */
+void cstr_sort(cstr **strs, size_t n)
+{
+	if (n > 1)
+		sort_range(strs, n);
+}
+
+/*
+ * Parallel sorting
+ * Every job either sorts its range of \src or merges two sorted neighbouring
+ * ranges of \src into \dst.
+ */
+
+struct sort_job {
+	pthread_t thread;
+	bool started;
+	cstr **src;
+	cstr **dst;
+	size_t begin;
+	size_t mid;
+	size_t end;
+};
+
+static void *sort_job(void *arg)
+{
+	struct sort_job *job = arg;
+
+	sort_range(&job->src[job->begin], job->end - job->begin);
+	return NULL;
+}
+
+static void *merge_job(void *arg)
+{
+	struct sort_job *job = arg;
+	cstr **src = job->src, **dst = job->dst;
+	size_t i = job->begin, j = job->mid, k = job->begin;
+
+	while (i < job->mid && j < job->end) {
+		if (cstr_order(src[j], src[i]) < 0)
+			dst[k++] = src[j++];
+		else
+			dst[k++] = src[i++];
+	}
+
+	memcpy(&dst[k], &src[i], (job->mid - i) * sizeof(*dst));
+	k += job->mid - i;
+	memcpy(&dst[k], &src[j], (job->end - j) * sizeof(*dst));
+
+	return NULL;
+}
+
+/* runs all jobs in their own thread, or inline if that fails */
+static void run_jobs(struct sort_job *jobs, size_t num,
+						void *(*fn)(void *arg))
+{
+	size_t i;
+
+	for (i = 0; i < num; ++i)
+		jobs[i].started = !pthread_create(&jobs[i].thread, NULL, fn,
+								&jobs[i]);
+
+	for (i = 0; i < num; ++i) {
+		if (jobs[i].started)
+			pthread_join(jobs[i].thread, NULL);
+		else
+			fn(&jobs[i]);
+	}
+}
+
+/*
+ * Sort array in parallel
+ * Like cstr_sort() but uses up to \threads threads. If \threads is 0, one
+ * thread per online CPU is used. Small arrays are sorted in the calling
+ * thread. This needs another \n pointers of temporary memory; if that cannot
+ * be allocated or threads cannot be created, the work is done in the calling
+ * thread instead.
+ */
+void cstr_sort_parallel(cstr **strs, size_t n, unsigned int threads)
+{
+	struct sort_job *jobs;
+	cstr **tmp, **src, **dst;
+	size_t i, num, parts, width;
+	long cpus;
+
+	if (!threads) {
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cpus > 0 ? cpus : 1;
+	}
+
+	if (threads < 2 || n < SORT_PARALLEL_MIN) {
+		cstr_sort(strs, n);
+		return;
+	}
+
+	tmp = cstr__malloc(n * sizeof(*tmp));
+	jobs = cstr__malloc(threads * sizeof(*jobs));
+	if (!tmp || !jobs) {
+		cstr__free(jobs);
+		cstr__free(tmp);
+		cstr_sort(strs, n);
+		return;
+	}
+
+	parts = threads;
+	for (i = 0; i < parts; ++i) {
+		jobs[i].src = strs;
+		jobs[i].begin = n * i / parts;
+		jobs[i].end = n * (i + 1) / parts;
+	}
+	run_jobs(jobs, parts, sort_job);
+
+	/* merge neighbouring parts until a single one is left */
+	src = strs;
+	dst = tmp;
+	for (width = 1; width < parts; width *= 2) {
+		num = 0;
+		for (i = 0; i < parts; i += 2 * width) {
+			jobs[num].src = src;
+			jobs[num].dst = dst;
+			jobs[num].begin = n * i / parts;
+			if (i + width < parts) {
+				jobs[num].mid = n * (i + width) / parts;
+				jobs[num].end = n * (i + 2 * width < parts ?
+						i + 2 * width : parts) / parts;
+			} else {
+				jobs[num].mid = n;
+				jobs[num].end = n;
+			}
+			++num;
+		}
+		run_jobs(jobs, num, merge_job);
+
+		src = dst;
+		dst = (dst == tmp) ? strs : tmp;
+	}
+
+	if (src != strs)
+		memcpy(strs, src, n * sizeof(*strs));
+
+	cstr__free(jobs);
+	cstr__free(tmp);
+}
@@ -0,0 +1,181 @@
+/*
+ * Static C-strings and arrays
+ * Written 2011 by David Herrmann
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * Allocation Statistics
+ * If the library is built with CSTR_STATS defined (make STATS=1), the
+ * allocator hooks and cstr__fit() count what they do. Otherwise all counting
+ * macros expand to nothing and cstr_stats_get() only reports that no
+ * statistics are available.
+ *
+ * Counters are kept per thread so the hot paths never write to shared cache
+ * lines. Every thread registers its counter block on first use in a global
+ * list. Only the owning thread writes to a block, other threads merely read it
+ * when a snapshot is taken. When a thread exits, its counters are added to the
+ * retired totals and the block is released.
+ *
+ * Live and peak bytes are process-wide properties as buffers are often freed
+ * by another thread than the one that allocated them. They are kept in global
+ * atomics instead. Buffer sizes are only known while the allocator of the C
+ * library is used as they are taken from malloc_usable_size(). With a custom
+ * allocator, live and peak bytes stay zero.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cstr.h"
+#include "libcstr.h"
+
+#ifdef CSTR_STATS
+
+#include <pthread.h>
+
+struct stats_block {
+	struct cstr__stats stats;
+	struct stats_block *next;
+	struct stats_block **prev;
+};
+
+__thread struct cstr__stats *cstr__stats_local;
+
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t stats_key;
+static struct stats_block *stats_list;
+static struct cstr__stats stats_retired;
+static int64_t stats_live;
+static int64_t stats_peak;
+
+static void stats_sum(struct cstr__stats *dst, const struct cstr__stats *src)
+{
+	dst->allocs += __atomic_load_n(&src->allocs, __ATOMIC_RELAXED);
+	dst->frees += __atomic_load_n(&src->frees, __ATOMIC_RELAXED);
+	dst->reallocs += __atomic_load_n(&src->reallocs, __ATOMIC_RELAXED);
+	dst->relocs += __atomic_load_n(&src->relocs, __ATOMIC_RELAXED);
+	dst->reloc_bytes += __atomic_load_n(&src->reloc_bytes,
+							__ATOMIC_RELAXED);
+	dst->copyouts += __atomic_load_n(&src->copyouts, __ATOMIC_RELAXED);
+	dst->copyout_bytes += __atomic_load_n(&src->copyout_bytes,
+							__ATOMIC_RELAXED);
+}
+
+/* called on thread exit with the block of the exiting thread */
+static void stats_retire(void *data)
+{
+	struct stats_block *block = data;
+
+	pthread_mutex_lock(&stats_lock);
+	stats_sum(&stats_retired, &block->stats);
+	*block->prev = block->next;
+	if (block->next)
+		block->next->prev = block->prev;
+	pthread_mutex_unlock(&stats_lock);
+
+	cstr__stats_local = NULL;
+	free(block);
+}
+
+static void stats_init(void)
+{
+	pthread_key_create(&stats_key, stats_retire);
+}
+
+/*
+ * Registers a counter block for the calling thread. The block is allocated
+ * with the C library directly so it is neither counted nor dependent on the
+ * allocator hooks. If that fails, a static dummy block is used and the
+ * counters of this thread are lost.
+ */
+struct cstr__stats *cstr__stats_register(void)
+{
+	static __thread struct cstr__stats dummy;
+	struct stats_block *block;
+
+	pthread_once(&stats_once, stats_init);
+
+	block = calloc(1, sizeof(*block));
+	if (!block) {
+		cstr__stats_local = &dummy;
+		return cstr__stats_local;
+	}
+
+	pthread_mutex_lock(&stats_lock);
+	block->next = stats_list;
+	block->prev = &stats_list;
+	if (stats_list)
+		stats_list->prev = &block->next;
+	stats_list = block;
+	pthread_mutex_unlock(&stats_lock);
+
+	pthread_setspecific(stats_key, block);
+	cstr__stats_local = &block->stats;
+
+	return cstr__stats_local;
+}
+
+void cstr__stats_live(int64_t diff)
+{
+	int64_t live, peak;
+
+	live = __atomic_add_fetch(&stats_live, diff, __ATOMIC_RELAXED);
+	peak = __atomic_load_n(&stats_peak, __ATOMIC_RELAXED);
+	while (live > peak) {
+		if (__atomic_compare_exchange_n(&stats_peak, &peak, live, true,
+					__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			break;
+	}
+}
+
+static void stats_snapshot(struct cstr_stats *stats)
+{
+	struct cstr__stats sum;
+	struct stats_block *iter;
+	int64_t live;
+
+	pthread_mutex_lock(&stats_lock);
+	sum = stats_retired;
+	for (iter = stats_list; iter; iter = iter->next)
+		stats_sum(&sum, &iter->stats);
+	pthread_mutex_unlock(&stats_lock);
+
+	live = __atomic_load_n(&stats_live, __ATOMIC_RELAXED);
+
+	stats->allocs = sum.allocs;
+	stats->frees = sum.frees;
+	stats->reallocs = sum.reallocs;
+	stats->relocs = sum.relocs;
+	stats->reloc_bytes = sum.reloc_bytes;
+	stats->copyouts = sum.copyouts;
+	stats->copyout_bytes = sum.copyout_bytes;
+	stats->live_bytes = live > 0 ? live : 0;
+	stats->peak_bytes = __atomic_load_n(&stats_peak, __ATOMIC_RELAXED);
+}
+
+#endif /* CSTR_STATS */
+
+/*
+ * Statistics snapshot
+ * Fills \stats with the sum of the counters of all threads that ever used the
+ * library. The counters of running threads are read while they may still
+ * change, so the snapshot is not atomic across counters.
+ * Live bytes can be slightly off if the library frees buffers it did not
+ * allocate, for instance buffers passed to cstr_alloc(). They never drop below
+ * zero in a snapshot.
+ * Returns false and zeroes \stats if the library was built without CSTR_STATS.
+ */
+bool cstr_stats_get(struct cstr_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+
+#ifdef CSTR_STATS
+	stats_snapshot(stats);
+	return true;
+#else
+	return false;
+#endif
+}
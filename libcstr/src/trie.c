@@ -0,0 +1,682 @@
+/*
+ * Static C-strings and arrays
+ * Written 2011 by David Herrmann
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * Radix Trees
+ * A cstr_trie is an adaptive radix tree. Each node branches on a single byte
+ * and comes in four sizes depending on its number of children:
+ *  node4 and node16: sorted arrays of up to 4 or 16 key bytes and children.
+ *                    node16 is searched with a single SSE2 compare.
+ *  node48: a 256 byte index into an array of up to 48 children.
+ *  node256: an array of 256 children.
+ * Nodes grow into the next size when they are full. Chains of nodes with a
+ * single child are compressed into the prefix of the next node, which is
+ * stored in the same allocation as the node. A key ends either in a node
+ * without children or in an inner node, so every node can carry a value.
+ * Keys are binary safe and may be prefixes of each other. The keys themselves
+ * are not stored; they are the paths to the nodes.
+ *
+ * Child arrays of node4 and node16 are sorted, so walking the tree visits the
+ * keys in the order of cstr_order().
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cstr.h"
+#include "libcstr.h"
+
+#ifdef __SSE2__
+	#include <emmintrin.h>
+#endif
+
+enum {
+	NODE4,
+	NODE16,
+	NODE48,
+	NODE256,
+};
+
+struct trie_node {
+	uint8_t type;
+	bool has_value;
+	uint16_t num;
+	uint32_t prefix_len;
+	uint8_t *prefix;
+	void *value;
+};
+
+struct node4 {
+	struct trie_node n;
+	uint8_t keys[4];
+	struct trie_node *child[4];
+};
+
+struct node16 {
+	struct trie_node n;
+	uint8_t keys[16];
+	struct trie_node *child[16];
+};
+
+struct node48 {
+	struct trie_node n;
+	uint8_t index[256];
+	struct trie_node *child[48];
+};
+
+struct node256 {
+	struct trie_node n;
+	struct trie_node *child[256];
+};
+
+static const size_t node_sizes[] = {
+	[NODE4] = sizeof(struct node4),
+	[NODE16] = sizeof(struct node16),
+	[NODE48] = sizeof(struct node48),
+	[NODE256] = sizeof(struct node256),
+};
+
+static const unsigned int node_max[] = {
+	[NODE4] = 4,
+	[NODE16] = 16,
+	[NODE48] = 48,
+	[NODE256] = 256,
+};
+
+/* allocates a node without children; the prefix is stored behind it */
+static struct trie_node *node_new(unsigned int type, const uint8_t *prefix,
+							size_t prefix_len)
+{
+	struct trie_node *node;
+
+	node = cstr__malloc(node_sizes[type] + prefix_len);
+	if (!node)
+		return NULL;
+
+	memset(node, 0, node_sizes[type]);
+	node->type = type;
+	node->prefix_len = prefix_len;
+	node->prefix = (uint8_t*)node + node_sizes[type];
+	memcpy(node->prefix, prefix, prefix_len);
+
+	return node;
+}
+
+static void node_free(struct trie_node *node)
+{
+	struct node48 *n48;
+	struct node256 *n256;
+	unsigned int i;
+
+	if (!node)
+		return;
+
+	switch (node->type) {
+	case NODE4:
+		for (i = 0; i < node->num; ++i)
+			node_free(((struct node4*)node)->child[i]);
+		break;
+	case NODE16:
+		for (i = 0; i < node->num; ++i)
+			node_free(((struct node16*)node)->child[i]);
+		break;
+	case NODE48:
+		n48 = (struct node48*)node;
+		for (i = 0; i < node->num; ++i)
+			node_free(n48->child[i]);
+		break;
+	case NODE256:
+		n256 = (struct node256*)node;
+		for (i = 0; i < 256; ++i)
+			node_free(n256->child[i]);
+		break;
+	}
+
+	cstr__free(node);
+}
+
+/* returns the slot of the child for byte \c or NULL */
+static struct trie_node **find_child(struct trie_node *node, uint8_t c)
+{
+	struct node4 *n4;
+	struct node16 *n16;
+	struct node48 *n48;
+	unsigned int i;
+#ifdef __SSE2__
+	__m128i cmp;
+	unsigned int m;
+#endif
+
+	switch (node->type) {
+	case NODE4:
+		n4 = (struct node4*)node;
+		for (i = 0; i < node->num; ++i) {
+			if (n4->keys[i] == c)
+				return &n4->child[i];
+		}
+		return NULL;
+	case NODE16:
+		n16 = (struct node16*)node;
+#ifdef __SSE2__
+		cmp = _mm_cmpeq_epi8(_mm_set1_epi8(c),
+			_mm_loadu_si128((const __m128i*)n16->keys));
+		m = _mm_movemask_epi8(cmp) & ((1U << node->num) - 1);
+		return m ? &n16->child[__builtin_ctz(m)] : NULL;
+#else
+		for (i = 0; i < node->num; ++i) {
+			if (n16->keys[i] == c)
+				return &n16->child[i];
+		}
+		return NULL;
+#endif
+	case NODE48:
+		n48 = (struct node48*)node;
+		return n48->index[c] ? &n48->child[n48->index[c] - 1] : NULL;
+	case NODE256:
+		return ((struct node256*)node)->child[c] ?
+				&((struct node256*)node)->child[c] : NULL;
+	}
+
+	return NULL;
+}
+
+/* copies all children of \old into \node, which is the next node size */
+static void node_move(struct trie_node *node, struct trie_node *old)
+{
+	struct node4 *o4 = (struct node4*)old;
+	struct node16 *o16 = (struct node16*)old, *n16 = (struct node16*)node;
+	struct node48 *o48 = (struct node48*)old, *n48 = (struct node48*)node;
+	struct node256 *n256 = (struct node256*)node;
+	unsigned int i;
+
+	node->has_value = old->has_value;
+	node->value = old->value;
+	node->num = old->num;
+
+	switch (old->type) {
+	case NODE4:
+		memcpy(n16->keys, o4->keys, old->num);
+		memcpy(n16->child, o4->child, old->num * sizeof(*o4->child));
+		break;
+	case NODE16:
+		for (i = 0; i < old->num; ++i) {
+			n48->index[o16->keys[i]] = i + 1;
+			n48->child[i] = o16->child[i];
+		}
+		break;
+	case NODE48:
+		for (i = 0; i < 256; ++i) {
+			if (o48->index[i])
+				n256->child[i] = o48->child[o48->index[i] - 1];
+		}
+		break;
+	}
+}
+
+/* inserts \child for byte \c into the sorted arrays of node4 and node16 */
+static void sorted_insert(uint8_t *keys, struct trie_node **children,
+			unsigned int num, uint8_t c, struct trie_node *child)
+{
+	unsigned int i;
+
+	for (i = 0; i < num && keys[i] < c; ++i)
+		;
+
+	memmove(&keys[i + 1], &keys[i], num - i);
+	memmove(&children[i + 1], &children[i], (num - i) * sizeof(*children));
+	keys[i] = c;
+	children[i] = child;
+}
+
+/*
+ * Adds \child for byte \c to *\ref. If the node is full, it is replaced by a
+ * bigger node. Returns false on memory allocation failure.
+ */
+static bool add_child(struct trie_node **ref, uint8_t c,
+						struct trie_node *child)
+{
+	struct trie_node *node = *ref, *bigger;
+	struct node48 *n48;
+
+	if (node->num == node_max[node->type]) {
+		bigger = node_new(node->type + 1, node->prefix,
+							node->prefix_len);
+		if (!bigger)
+			return false;
+
+		node_move(bigger, node);
+		cstr__free(node);
+		*ref = node = bigger;
+	}
+
+	switch (node->type) {
+	case NODE4:
+		sorted_insert(((struct node4*)node)->keys,
+				((struct node4*)node)->child, node->num, c,
+				child);
+		break;
+	case NODE16:
+		sorted_insert(((struct node16*)node)->keys,
+				((struct node16*)node)->child, node->num, c,
+				child);
+		break;
+	case NODE48:
+		n48 = (struct node48*)node;
+		n48->child[node->num] = child;
+		n48->index[c] = node->num + 1;
+		break;
+	case NODE256:
+		((struct node256*)node)->child[c] = child;
+		break;
+	}
+
+	++node->num;
+	return true;
+}
+
+static struct trie_node *leaf_new(const uint8_t *prefix, size_t prefix_len,
+								void *value)
+{
+	struct trie_node *node;
+
+	node = node_new(NODE4, prefix, prefix_len);
+	if (node) {
+		node->has_value = true;
+		node->value = value;
+	}
+
+	return node;
+}
+
+static size_t mismatch(const uint8_t *a, size_t na, const uint8_t *b,
+								size_t nb)
+{
+	size_t i, n = na < nb ? na : nb;
+
+	for (i = 0; i < n && a[i] == b[i]; ++i)
+		;
+
+	return i;
+}
+
+void cstr_trie_init(struct cstr_trie *trie)
+{
+	trie->root = NULL;
+	trie->num = 0;
+}
+
+void cstr_trie_destroy(struct cstr_trie *trie)
+{
+	node_free(trie->root);
+	cstr_trie_init(trie);
+}
+
+/*
+ * Insert key
+ * Inserts \key with \value into \trie. If \key is already present, its value
+ * is replaced. The key is not referenced after this call.
+ * Returns false on memory allocation failure.
+ */
+bool cstr_trie_insert(struct cstr_trie *trie, const cstr *key, void *value)
+{
+	const uint8_t *k = CSTR_UINT8(key);
+	size_t len = CSTR_LEN(key), depth = 0, p;
+	struct trie_node **ref = &trie->root, *node, *split, *leaf, **child;
+
+	while (1) {
+		node = *ref;
+		if (!node) {
+			*ref = leaf_new(&k[depth], len - depth, value);
+			if (!*ref)
+				return false;
+			++trie->num;
+			return true;
+		}
+
+		p = mismatch(node->prefix, node->prefix_len, &k[depth],
+								len - depth);
+		if (p < node->prefix_len) {
+			/* split the prefix of \node at \p */
+			split = node_new(NODE4, node->prefix, p);
+			if (!split)
+				return false;
+
+			leaf = NULL;
+			if (depth + p == len) {
+				split->has_value = true;
+				split->value = value;
+			} else {
+				leaf = leaf_new(&k[depth + p + 1],
+						len - depth - p - 1, value);
+				if (!leaf) {
+					cstr__free(split);
+					return false;
+				}
+			}
+
+			add_child(&split, node->prefix[p], node);
+			node->prefix_len -= p + 1;
+			memmove(node->prefix, node->prefix + p + 1,
+							node->prefix_len);
+			if (leaf)
+				add_child(&split, k[depth + p], leaf);
+
+			*ref = split;
+			++trie->num;
+			return true;
+		}
+
+		depth += node->prefix_len;
+		if (depth == len) {
+			trie->num += !node->has_value;
+			node->has_value = true;
+			node->value = value;
+			return true;
+		}
+
+		child = find_child(node, k[depth]);
+		if (!child) {
+			leaf = leaf_new(&k[depth + 1], len - depth - 1, value);
+			if (!leaf)
+				return false;
+			if (!add_child(ref, k[depth], leaf)) {
+				cstr__free(leaf);
+				return false;
+			}
+			++trie->num;
+			return true;
+		}
+
+		ref = child;
+		++depth;
+	}
+}
+
+/*
+ * Exact lookup
+ * Returns a pointer to the value of \key or NULL if \key is not in \trie.
+ */
+void **cstr_trie_find(const struct cstr_trie *trie, const cstr *key)
+{
+	const uint8_t *k = CSTR_UINT8(key);
+	size_t len = CSTR_LEN(key), depth = 0;
+	struct trie_node *node = trie->root, **child;
+
+	while (node) {
+		if (len - depth < node->prefix_len ||
+		    memcmp(node->prefix, &k[depth], node->prefix_len))
+			return NULL;
+
+		depth += node->prefix_len;
+		if (depth == len)
+			return node->has_value ? &node->value : NULL;
+
+		child = find_child(node, k[depth++]);
+		node = child ? *child : NULL;
+	}
+
+	return NULL;
+}
+
+/*
+ * Longest prefix match
+ * Returns a pointer to the value of the longest key in \trie that is a prefix
+ * of \key, or NULL if there is none. The length of that key is stored in
+ * \match_len if it is not NULL.
+ */
+void **cstr_trie_longest(const struct cstr_trie *trie, const cstr *key,
+							size_t *match_len)
+{
+	const uint8_t *k = CSTR_UINT8(key);
+	size_t len = CSTR_LEN(key), depth = 0, best_len = 0;
+	struct trie_node *node = trie->root, *best = NULL, **child;
+
+	while (node) {
+		if (len - depth < node->prefix_len ||
+		    memcmp(node->prefix, &k[depth], node->prefix_len))
+			break;
+
+		depth += node->prefix_len;
+		if (node->has_value) {
+			best = node;
+			best_len = depth;
+		}
+		if (depth == len)
+			break;
+
+		child = find_child(node, k[depth++]);
+		node = child ? *child : NULL;
+	}
+
+	if (!best)
+		return NULL;
+	if (match_len)
+		*match_len = best_len;
+	return &best->value;
+}
+
+struct walk {
+	cstr *key;
+	int (*fn) (const cstr *key, void *value, void *data);
+	void *data;
+};
+
+static int walk_child(struct walk *w, struct trie_node *node, size_t depth,
+								uint8_t c);
+
+/* calls the callback for all keys below \node; \w->key holds \depth bytes */
+static int walk_node(struct walk *w, struct trie_node *node, size_t depth)
+{
+	struct node4 *n4 = (struct node4*)node;
+	struct node16 *n16 = (struct node16*)node;
+	struct node48 *n48 = (struct node48*)node;
+	struct node256 *n256 = (struct node256*)node;
+	unsigned int i;
+	int r;
+
+	if (!cstr__fit(w->key, depth + node->prefix_len, false))
+		return -ENOMEM;
+	memcpy(w->key->buf + depth, node->prefix, node->prefix_len);
+	depth += node->prefix_len;
+
+	if (node->has_value) {
+		r = w->fn(w->key, node->value, w->data);
+		if (r)
+			return r;
+	}
+
+	r = 0;
+	switch (node->type) {
+	case NODE4:
+		for (i = 0; !r && i < node->num; ++i)
+			r = walk_child(w, n4->child[i], depth, n4->keys[i]);
+		break;
+	case NODE16:
+		for (i = 0; !r && i < node->num; ++i)
+			r = walk_child(w, n16->child[i], depth, n16->keys[i]);
+		break;
+	case NODE48:
+		for (i = 0; !r && i < 256; ++i) {
+			if (n48->index[i])
+				r = walk_child(w, n48->child[n48->index[i] - 1],
+								depth, i);
+		}
+		break;
+	case NODE256:
+		for (i = 0; !r && i < 256; ++i) {
+			if (n256->child[i])
+				r = walk_child(w, n256->child[i], depth, i);
+		}
+		break;
+	}
+
+	return r;
+}
+
+static int walk_child(struct walk *w, struct trie_node *node, size_t depth,
+								uint8_t c)
+{
+	if (!cstr__fit(w->key, depth + 1, false))
+		return -ENOMEM;
+	w->key->buf[depth] = c;
+
+	return walk_node(w, node, depth + 1);
+}
+
+/*
+ * Prefix iteration
+ * Calls \fn for every key in \trie that starts with \prefix, in the order of
+ * cstr_order(). \key is only valid during the callback and \trie must not be
+ * modified by it. If \fn returns non-zero, the walk stops and that value is
+ * returned. Otherwise 0 is returned, or -ENOMEM on memory allocation failure.
+ */
+int cstr_trie_walk(const struct cstr_trie *trie, const cstr *prefix,
+		int (*fn) (const cstr *key, void *value, void *data),
+		void *data)
+{
+	const uint8_t *k = CSTR_UINT8(prefix);
+	size_t len = CSTR_LEN(prefix), depth = 0, n;
+	struct trie_node *node = trie->root, **child;
+	struct walk w;
+	int r;
+
+	/* find the first node whose subtree only contains matching keys */
+	while (node) {
+		n = len - depth;
+		if (n <= node->prefix_len) {
+			if (memcmp(node->prefix, &k[depth], n))
+				node = NULL;
+			break;
+		}
+
+		if (memcmp(node->prefix, &k[depth], node->prefix_len))
+			return 0;
+
+		depth += node->prefix_len;
+		child = find_child(node, k[depth++]);
+		node = child ? *child : NULL;
+	}
+
+	if (!node)
+		return 0;
+
+	w.key = cstr_new(0);
+	if (!w.key)
+		return -ENOMEM;
+	w.fn = fn;
+	w.data = data;
+
+	if (!cstr__fit(w.key, depth, false)) {
+		r = -ENOMEM;
+	} else {
+		memcpy(w.key->buf, k, depth);
+		r = walk_node(&w, node, depth);
+	}
+
+	cstr_free(w.key);
+	return r;
+}
+
+/*
+ * Builds a subtree from \n sorted keys which are equal up to \depth. The
+ * common prefix of the range is the common prefix of its first and last key.
+ */
+static struct trie_node *build(cstr *const *keys, void *const *values,
+					size_t n, size_t depth, size_t *num)
+{
+	const cstr *first = keys[0], *last = keys[n - 1];
+	struct trie_node *node, *child;
+	size_t lcp, i, j, groups;
+	unsigned int type;
+	bool has_value;
+	void *value;
+	uint8_t c;
+
+	lcp = mismatch(CSTR_UINT8(first) + depth, CSTR_LEN(first) - depth,
+			CSTR_UINT8(last) + depth, CSTR_LEN(last) - depth);
+
+	/* keys that end here are sorted first; the last duplicate wins */
+	has_value = false;
+	value = NULL;
+	i = 0;
+	while (i < n && CSTR_LEN(keys[i]) == depth + lcp) {
+		has_value = true;
+		value = values ? values[i] : NULL;
+		++i;
+	}
+	*num += has_value;
+
+	groups = 0;
+	for (j = i; j < n; ++j) {
+		if (j == i || CSTR_UINT8(keys[j])[depth + lcp] !=
+				CSTR_UINT8(keys[j - 1])[depth + lcp])
+			++groups;
+	}
+
+	if (groups <= 4)
+		type = NODE4;
+	else if (groups <= 16)
+		type = NODE16;
+	else if (groups <= 48)
+		type = NODE48;
+	else
+		type = NODE256;
+
+	node = node_new(type, CSTR_UINT8(first) + depth, lcp);
+	if (!node)
+		return NULL;
+	node->has_value = has_value;
+	node->value = value;
+
+	depth += lcp;
+	while (i < n) {
+		c = CSTR_UINT8(keys[i])[depth];
+		for (j = i + 1; j < n && CSTR_UINT8(keys[j])[depth] == c; ++j)
+			;
+
+		child = build(&keys[i], values ? &values[i] : NULL, j - i,
+							depth + 1, num);
+		if (!child) {
+			node_free(node);
+			return NULL;
+		}
+
+		add_child(&node, c, child);
+		i = j;
+	}
+
+	return node;
+}
+
+/*
+ * Bulk build
+ * Inserts \n keys with their \values into the empty \trie. \keys must be
+ * sorted with cstr_sort() or in the order of cstr_order(). For duplicate keys
+ * the last value is used. \values may be NULL to set all values to NULL.
+ * Nodes are created with their final size and each key byte is visited about
+ * once, which is much faster than inserting the keys one by one.
+ * Returns false on memory allocation failure; \trie is empty then.
+ */
+bool cstr_trie_build(struct cstr_trie *trie, cstr *const *keys,
+					void *const *values, size_t n)
+{
+	size_t num = 0;
+
+	assert(!trie->root);
+
+	if (!n)
+		return true;
+
+	trie->root = build(keys, values, n, 0, &num);
+	if (!trie->root)
+		return false;
+
+	trie->num = num;
+	return true;
+}
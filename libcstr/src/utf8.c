@@ -0,0 +1,588 @@
+/*
+ * Static C-strings and arrays
+ * Written 2011 by David Herrmann
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * UTF-8
+ * cstr objects are binary safe and do not care about encodings. The functions
+ * here validate, measure and transcode strings which are expected to be UTF-8.
+ * Overlong encodings, surrogates and code points above U+10FFFF are invalid.
+ *
+ * Like the search functions, the kernels are selected at runtime on first use.
+ * The scalar kernels decode one sequence at a time and skip ASCII eight bytes
+ * at once. The SSE2 kernels skip ASCII blocks of 16 bytes and fall back to the
+ * scalar decoder for the rest. With SSSE3 and AVX2 the validation is done
+ * entirely in vector registers with the lookup algorithm of Keiser and Lemire:
+ * each byte and its predecessor are classified with three 16-entry nibble
+ * tables (pshufb) so every error class sets a bit. Continuation bytes of
+ * three and four byte sequences are checked separately by looking two and
+ * three bytes back. The last block is zero padded, which turns a truncated
+ * sequence into an error, too.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cstr.h"
+#include "libcstr.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+	#define UTF8_SIMD 1
+	#include <immintrin.h>
+#endif
+
+struct utf8_ops {
+	bool (*valid) (const uint8_t *s, size_t n);
+	size_t (*count) (const uint8_t *s, size_t n);
+	size_t (*ascii) (const uint8_t *s, size_t n);
+};
+
+/*
+ * Decode a single sequence at \s with \n bytes left. Returns its length and
+ * stores the code point in \cp, or returns 0 if the sequence is invalid.
+ */
+static size_t decode(const uint8_t *s, size_t n, uint32_t *cp)
+{
+	uint32_t c = s[0], min;
+	size_t len, i;
+
+	if (c < 0x80) {
+		*cp = c;
+		return 1;
+	} else if (c < 0xc2) {
+		return 0;
+	} else if (c < 0xe0) {
+		len = 2;
+		c &= 0x1f;
+		min = 0x80;
+	} else if (c < 0xf0) {
+		len = 3;
+		c &= 0x0f;
+		min = 0x800;
+	} else if (c < 0xf5) {
+		len = 4;
+		c &= 0x07;
+		min = 0x10000;
+	} else {
+		return 0;
+	}
+
+	if (n < len)
+		return 0;
+
+	for (i = 1; i < len; ++i) {
+		if ((s[i] & 0xc0) != 0x80)
+			return 0;
+		c = (c << 6) | (s[i] & 0x3f);
+	}
+
+	if (c < min || c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff))
+		return 0;
+
+	*cp = c;
+	return len;
+}
+
+/*
+ * Scalar kernels
+ */
+
+static size_t ascii_scalar(const uint8_t *s, size_t n)
+{
+	uint64_t w;
+	size_t i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		memcpy(&w, &s[i], 8);
+		if (w & 0x8080808080808080ULL)
+			break;
+	}
+
+	while (i < n && s[i] < 0x80)
+		++i;
+
+	return i;
+}
+
+static bool valid_scalar(const uint8_t *s, size_t n)
+{
+	uint32_t cp;
+	size_t i, len;
+
+	i = 0;
+	while (i < n) {
+		i += ascii_scalar(&s[i], n - i);
+		if (i == n)
+			break;
+
+		len = decode(&s[i], n - i, &cp);
+		if (!len)
+			return false;
+		i += len;
+	}
+
+	return true;
+}
+
+/* every byte that is not a continuation byte starts a code point */
+static size_t count_scalar(const uint8_t *s, size_t n)
+{
+	size_t i, num = 0;
+
+	for (i = 0; i < n; ++i)
+		num += (s[i] & 0xc0) != 0x80;
+
+	return num;
+}
+
+static const struct utf8_ops ops_scalar = {
+	.valid = valid_scalar,
+	.count = count_scalar,
+	.ascii = ascii_scalar,
+};
+
+#ifdef UTF8_SIMD
+
+/*
+ * SSE2 kernels
+ */
+
+static size_t ascii_sse2(const uint8_t *s, size_t n)
+{
+	unsigned int m;
+	size_t i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		m = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)&s[i]));
+		if (m)
+			return i + __builtin_ctz(m);
+	}
+
+	return i + ascii_scalar(&s[i], n - i);
+}
+
+static bool valid_sse2(const uint8_t *s, size_t n)
+{
+	uint32_t cp;
+	size_t i, end, len;
+
+	i = 0;
+	while (i + 16 <= n) {
+		i += ascii_sse2(&s[i], n - i);
+		if (i == n)
+			return true;
+
+		/* decode at least one block before searching ASCII again */
+		end = i + 16;
+		while (i < end && i < n) {
+			len = decode(&s[i], n - i, &cp);
+			if (!len)
+				return false;
+			i += len;
+		}
+	}
+
+	return valid_scalar(&s[i], n - i);
+}
+
+static size_t count_sse2(const uint8_t *s, size_t n)
+{
+	const __m128i cont = _mm_set1_epi8(-65);
+	__m128i b;
+	size_t i, num = 0;
+
+	/* continuation bytes are 0x80 to 0xbf, that is -128 to -65 signed */
+	for (i = 0; i + 16 <= n; i += 16) {
+		b = _mm_loadu_si128((const __m128i*)&s[i]);
+		num += __builtin_popcount(_mm_movemask_epi8(
+						_mm_cmpgt_epi8(b, cont)));
+	}
+
+	return num + count_scalar(&s[i], n - i);
+}
+
+static const struct utf8_ops ops_sse2 = {
+	.valid = valid_sse2,
+	.count = count_sse2,
+	.ascii = ascii_sse2,
+};
+
+/*
+ * Lookup tables
+ * Error classes of a byte pair. A pair is invalid if all three tables agree
+ * on one class. TWO_CONTS is no error by itself; it must match exactly the
+ * positions that are expected to be the third or fourth byte of a sequence.
+ */
+
+#define TOO_SHORT	(1 << 0)
+#define TOO_LONG	(1 << 1)
+#define OVERLONG_3	(1 << 2)
+#define TOO_LARGE	(1 << 3)
+#define SURROGATE	(1 << 4)
+#define OVERLONG_2	(1 << 5)
+#define TOO_LARGE_1000	(1 << 6)
+#define OVERLONG_4	(1 << 6)
+#define TWO_CONTS	(1 << 7)
+#define CARRY		(TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+/* indexed by the high nibble of the first byte */
+static const uint8_t byte1_high[16] = {
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+	TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+	TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+	TOO_SHORT | OVERLONG_2,
+	TOO_SHORT,
+	TOO_SHORT | OVERLONG_3 | SURROGATE,
+	TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+};
+
+/* indexed by the low nibble of the first byte */
+static const uint8_t byte1_low[16] = {
+	CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+	CARRY | OVERLONG_2,
+	CARRY,
+	CARRY,
+	CARRY | TOO_LARGE,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+	CARRY | TOO_LARGE | TOO_LARGE_1000,
+};
+
+/* indexed by the high nibble of the second byte */
+static const uint8_t byte2_high[16] = {
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 |
+								OVERLONG_4,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+	TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+	TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+};
+
+/*
+ * Bytes above these values at the end of a block start a sequence that
+ * continues in the next block.
+ */
+static const uint8_t incomplete_max[32] = {
+	255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 255, 255, 255,
+	255, 255, 255, 255, 255, 0xf0 - 1, 0xe0 - 1, 0xc0 - 1,
+};
+
+/*
+ * SSSE3 kernels
+ */
+
+__attribute__((target("ssse3")))
+static inline __m128i check_ssse3(__m128i in, __m128i prev)
+{
+	const __m128i t1h = _mm_loadu_si128((const __m128i*)byte1_high);
+	const __m128i t1l = _mm_loadu_si128((const __m128i*)byte1_low);
+	const __m128i t2h = _mm_loadu_si128((const __m128i*)byte2_high);
+	const __m128i nib = _mm_set1_epi8(0x0f);
+	__m128i prev1, prev2, prev3, sc, must;
+
+	prev1 = _mm_alignr_epi8(in, prev, 15);
+	prev2 = _mm_alignr_epi8(in, prev, 14);
+	prev3 = _mm_alignr_epi8(in, prev, 13);
+
+	sc = _mm_shuffle_epi8(t1h, _mm_and_si128(_mm_srli_epi16(prev1, 4),
+									nib));
+	sc = _mm_and_si128(sc, _mm_shuffle_epi8(t1l,
+						_mm_and_si128(prev1, nib)));
+	sc = _mm_and_si128(sc, _mm_shuffle_epi8(t2h,
+			_mm_and_si128(_mm_srli_epi16(in, 4), nib)));
+
+	must = _mm_or_si128(_mm_subs_epu8(prev2, _mm_set1_epi8(0xe0 - 0x80)),
+			_mm_subs_epu8(prev3, _mm_set1_epi8(0xf0 - 0x80)));
+	must = _mm_and_si128(must, _mm_set1_epi8(0x80));
+
+	return _mm_xor_si128(must, sc);
+}
+
+__attribute__((target("ssse3")))
+static bool valid_ssse3(const uint8_t *s, size_t n)
+{
+	const __m128i max = _mm_loadu_si128((const __m128i*)
+							&incomplete_max[16]);
+	__m128i in, prev, err, incomplete;
+	uint8_t tail[16];
+	size_t i;
+
+	prev = _mm_setzero_si128();
+	err = _mm_setzero_si128();
+	incomplete = _mm_setzero_si128();
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		in = _mm_loadu_si128((const __m128i*)&s[i]);
+		if (!_mm_movemask_epi8(in)) {
+			err = _mm_or_si128(err, incomplete);
+			incomplete = _mm_setzero_si128();
+		} else {
+			err = _mm_or_si128(err, check_ssse3(in, prev));
+			incomplete = _mm_subs_epu8(in, max);
+		}
+		prev = in;
+	}
+
+	memset(tail, 0, sizeof(tail));
+	memcpy(tail, &s[i], n - i);
+	in = _mm_loadu_si128((const __m128i*)tail);
+	err = _mm_or_si128(err, check_ssse3(in, prev));
+
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(err, _mm_setzero_si128())) ==
+									0xffff;
+}
+
+static const struct utf8_ops ops_ssse3 = {
+	.valid = valid_ssse3,
+	.count = count_sse2,
+	.ascii = ascii_sse2,
+};
+
+/*
+ * AVX2 kernels
+ */
+
+__attribute__((target("avx2")))
+static size_t ascii_avx2(const uint8_t *s, size_t n)
+{
+	unsigned int m;
+	size_t i;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		m = _mm256_movemask_epi8(_mm256_loadu_si256(
+						(const __m256i*)&s[i]));
+		if (m)
+			return i + __builtin_ctz(m);
+	}
+
+	return i + ascii_sse2(&s[i], n - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i check_avx2(__m256i in, __m256i prev)
+{
+	const __m256i t1h = _mm256_broadcastsi128_si256(
+			_mm_loadu_si128((const __m128i*)byte1_high));
+	const __m256i t1l = _mm256_broadcastsi128_si256(
+			_mm_loadu_si128((const __m128i*)byte1_low));
+	const __m256i t2h = _mm256_broadcastsi128_si256(
+			_mm_loadu_si128((const __m128i*)byte2_high));
+	const __m256i nib = _mm256_set1_epi8(0x0f);
+	__m256i shifted, prev1, prev2, prev3, sc, must;
+
+	/* alignr works per lane; feed it the upper lane of \prev */
+	shifted = _mm256_permute2x128_si256(prev, in, 0x21);
+	prev1 = _mm256_alignr_epi8(in, shifted, 15);
+	prev2 = _mm256_alignr_epi8(in, shifted, 14);
+	prev3 = _mm256_alignr_epi8(in, shifted, 13);
+
+	sc = _mm256_shuffle_epi8(t1h, _mm256_and_si256(
+					_mm256_srli_epi16(prev1, 4), nib));
+	sc = _mm256_and_si256(sc, _mm256_shuffle_epi8(t1l,
+					_mm256_and_si256(prev1, nib)));
+	sc = _mm256_and_si256(sc, _mm256_shuffle_epi8(t2h,
+			_mm256_and_si256(_mm256_srli_epi16(in, 4), nib)));
+
+	must = _mm256_or_si256(
+		_mm256_subs_epu8(prev2, _mm256_set1_epi8(0xe0 - 0x80)),
+		_mm256_subs_epu8(prev3, _mm256_set1_epi8(0xf0 - 0x80)));
+	must = _mm256_and_si256(must, _mm256_set1_epi8(0x80));
+
+	return _mm256_xor_si256(must, sc);
+}
+
+__attribute__((target("avx2")))
+static bool valid_avx2(const uint8_t *s, size_t n)
+{
+	const __m256i max = _mm256_loadu_si256((const __m256i*)
+							incomplete_max);
+	__m256i in, prev, err, incomplete;
+	uint8_t tail[32];
+	size_t i;
+
+	prev = _mm256_setzero_si256();
+	err = _mm256_setzero_si256();
+	incomplete = _mm256_setzero_si256();
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		in = _mm256_loadu_si256((const __m256i*)&s[i]);
+		if (!_mm256_movemask_epi8(in)) {
+			err = _mm256_or_si256(err, incomplete);
+			incomplete = _mm256_setzero_si256();
+		} else {
+			err = _mm256_or_si256(err, check_avx2(in, prev));
+			incomplete = _mm256_subs_epu8(in, max);
+		}
+		prev = in;
+	}
+
+	memset(tail, 0, sizeof(tail));
+	memcpy(tail, &s[i], n - i);
+	in = _mm256_loadu_si256((const __m256i*)tail);
+	err = _mm256_or_si256(err, check_avx2(in, prev));
+
+	return _mm256_testz_si256(err, err);
+}
+
+__attribute__((target("avx2")))
+static size_t count_avx2(const uint8_t *s, size_t n)
+{
+	const __m256i cont = _mm256_set1_epi8(-65);
+	__m256i b;
+	size_t i, num = 0;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		b = _mm256_loadu_si256((const __m256i*)&s[i]);
+		num += __builtin_popcount(_mm256_movemask_epi8(
+					_mm256_cmpgt_epi8(b, cont)));
+	}
+
+	return num + count_sse2(&s[i], n - i);
+}
+
+static const struct utf8_ops ops_avx2 = {
+	.valid = valid_avx2,
+	.count = count_avx2,
+	.ascii = ascii_avx2,
+};
+
+#endif /* UTF8_SIMD */
+
+/* select the kernels for this CPU, see cpu.c */
+static const struct utf8_ops *utf8_ops(void)
+{
+#ifdef UTF8_SIMD
+	unsigned int isa = cstr__isa();
+
+	if (isa >= CSTR__ISA_AVX2)
+		return &ops_avx2;
+	if (isa >= CSTR__ISA_SSSE3)
+		return &ops_ssse3;
+	if (isa >= CSTR__ISA_SSE2)
+		return &ops_sse2;
+#endif
+
+	return &ops_scalar;
+}
+
+/*
+ * Validate UTF-8
+ * Returns true if \str is valid UTF-8. The empty string is valid.
+ */
+bool cstr_utf8_valid(const cstr *str)
+{
+	return utf8_ops()->valid(CSTR_UINT8(str), CSTR_LEN(str));
+}
+
+/*
+ * UTF-8 length
+ * Returns the number of code points in \str. \str must be valid UTF-8,
+ * otherwise the result is the number of bytes which are not continuation
+ * bytes.
+ */
+size_t cstr_utf8_len(const cstr *str)
+{
+	return utf8_ops()->count(CSTR_UINT8(str), CSTR_LEN(str));
+}
+
+/*
+ * Transcode UTF-8
+ * Converts \str into UTF-16 or UTF-32 in host byte order and stores the code
+ * units in \dst which has room for \n units. No terminating zero is written.
+ * A buffer of CSTR_LEN(str) units is always big enough. ASCII runs are found
+ * with the vector kernels and widened directly.
+ * Returns the number of units written, -EINVAL if \str is not valid UTF-8 or
+ * -ENOSPC if \dst is too small.
+ */
+ssize_t cstr_utf8_to_utf16(const cstr *str, uint16_t *dst, size_t n)
+{
+	const struct utf8_ops *ops = utf8_ops();
+	const uint8_t *s = CSTR_UINT8(str);
+	size_t i, j, k, run, len, l = CSTR_LEN(str);
+	uint32_t cp;
+
+	i = 0;
+	j = 0;
+	while (i < l) {
+		if (s[i] < 0x80) {
+			run = ops->ascii(&s[i], l - i);
+			if (run > n - j)
+				return -ENOSPC;
+			for (k = 0; k < run; ++k)
+				dst[j + k] = s[i + k];
+			i += run;
+			j += run;
+			continue;
+		}
+
+		len = decode(&s[i], l - i, &cp);
+		if (!len)
+			return -EINVAL;
+		i += len;
+
+		if (cp < 0x10000) {
+			if (j >= n)
+				return -ENOSPC;
+			dst[j++] = cp;
+		} else {
+			if (n - j < 2)
+				return -ENOSPC;
+			cp -= 0x10000;
+			dst[j++] = 0xd800 | (cp >> 10);
+			dst[j++] = 0xdc00 | (cp & 0x3ff);
+		}
+	}
+
+	return j;
+}
+
+ssize_t cstr_utf8_to_utf32(const cstr *str, uint32_t *dst, size_t n)
+{
+	const struct utf8_ops *ops = utf8_ops();
+	const uint8_t *s = CSTR_UINT8(str);
+	size_t i, j, k, run, len, l = CSTR_LEN(str);
+	uint32_t cp;
+
+	i = 0;
+	j = 0;
+	while (i < l) {
+		if (s[i] < 0x80) {
+			run = ops->ascii(&s[i], l - i);
+			if (run > n - j)
+				return -ENOSPC;
+			for (k = 0; k < run; ++k)
+				dst[j + k] = s[i + k];
+			i += run;
+			j += run;
+			continue;
+		}
+
+		len = decode(&s[i], l - i, &cp);
+		if (!len)
+			return -EINVAL;
+		i += len;
+
+		if (j >= n)
+			return -ENOSPC;
+		dst[j++] = cp;
+	}
+
+	return j;
+}
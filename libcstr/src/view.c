@@ -0,0 +1,152 @@
+/*
+ * Static C-strings and arrays
+ * Written 2011 by David Herrmann
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * Views
+ * Views reference parts of other buffers so slicing, trimming and splitting
+ * never allocate nor copy. Delimiters are searched with the vectorized kernels
+ * of the search functions.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cstr.h"
+#include "libcstr.h"
+
+static inline bool is_space(uint8_t c)
+{
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/*
+ * Trim views
+ * Returns \view without leading, trailing or both leading and trailing
+ * whitespace characters. Whitespace is classified like isspace() in the C
+ * locale.
+ */
+cstr_view cstr_view_ltrim(cstr_view view)
+{
+	while (view.len && is_space(*view.buf)) {
+		++view.buf;
+		--view.len;
+	}
+
+	return view;
+}
+
+cstr_view cstr_view_rtrim(cstr_view view)
+{
+	while (view.len && is_space(view.buf[view.len - 1]))
+		--view.len;
+
+	return view;
+}
+
+cstr_view cstr_view_trim(cstr_view view)
+{
+	return cstr_view_rtrim(cstr_view_ltrim(view));
+}
+
+/*
+ * Search views
+ * Same as cstr_chr() and cstr_find() but on views.
+ */
+ssize_t cstr_view_chr(cstr_view view, uint8_t c)
+{
+	const uint8_t *p;
+
+	p = cstr__memchr(view.buf, view.len, c);
+	return p ? p - view.buf : -1;
+}
+
+ssize_t cstr_view_find(cstr_view view, cstr_view needle)
+{
+	const uint8_t *p;
+
+	p = cstr__memmem(view.buf, view.len, needle.buf, needle.len);
+	return p ? p - view.buf : -1;
+}
+
+/*
+ * Split iterator
+ * Stores the next field of \split in \field and returns true. Returns false
+ * if all fields have been returned. A view with n delimiters always has n + 1
+ * fields, so an empty view has exactly one empty field.
+ */
+bool cstr_split_next(struct cstr_split *split, cstr_view *field)
+{
+	const uint8_t *p;
+
+	if (split->done)
+		return false;
+
+	p = NULL;
+	if (split->pos < split->end)
+		p = cstr__memchr(split->pos, split->end - split->pos,
+								split->delim);
+	if (!p) {
+		p = split->end;
+		split->done = true;
+	}
+
+	field->buf = split->pos;
+	field->len = p - split->pos;
+	split->pos = p + !split->done;
+
+	return true;
+}
+
+/*
+ * Tokenizer
+ * Initializes \tok to iterate over all tokens in \view which are separated by
+ * any character of \set. \set is not copied.
+ */
+void cstr_tokenizer_init(struct cstr_tokenizer *tok, cstr_view view,
+								cstr_view set)
+{
+	size_t i;
+
+	tok->pos = view.buf;
+	tok->end = view.buf + view.len;
+	tok->set = set.buf;
+	tok->set_len = set.len;
+	memset(tok->map, 0, sizeof(tok->map));
+
+	for (i = 0; i < set.len; ++i)
+		tok->map[set.buf[i] >> 6] |= 1ULL << (set.buf[i] & 63);
+}
+
+/*
+ * Next token
+ * Stores the next non-empty token of \tok in \token and returns true. Returns
+ * false if there are no more tokens.
+ * Runs of delimiters are usually short so they are skipped with the bitmap,
+ * the token itself is searched with the vector kernels.
+ */
+bool cstr_tokenizer_next(struct cstr_tokenizer *tok, cstr_view *token)
+{
+	const uint8_t *p, *end = tok->end;
+
+	p = tok->pos;
+	while (p < end && (tok->map[*p >> 6] & (1ULL << (*p & 63))))
+		++p;
+
+	if (p == end) {
+		tok->pos = end;
+		return false;
+	}
+
+	token->buf = p;
+	p = cstr__memchr_any(p, end - p, tok->set, tok->set_len);
+	if (!p)
+		p = end;
+	token->len = p - token->buf;
+	tok->pos = p;
+
+	return true;
+}
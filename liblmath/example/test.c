@@ -1,7 +1,429 @@
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "include/liblmath.h"
 
+/* asserts that all elements of \a and \b differ by at most \eps */
+static void expect_m4(lm_m4 a, lm_m4 b, lm_float eps)
+{
+	size_t i, j;
+
+	for (i = 0; i < 4; ++i)
+		for (j = 0; j < 4; ++j)
+			assert(fabsf(a[i][j] - b[i][j]) <= eps);
+}
+
+static bool is_identity(lm_m4 m)
+{
+	lm_m4 id;
+
+	lm_m4_identity(id);
+	return !memcmp(m, id, sizeof(id));
+}
+
+/*
+ * Singular matrices
+ * Translations do not change the determinant, so pure translations are
+ * invertible no matter how big they are. Uniformly scaled matrices are
+ * invertible for any scale. Matrices with linearly dependent rows are reported
+ * as singular and the destination is set to the identity.
+ */
+static void test_invert(void)
+{
+	static const lm_float trans[] = { 1, 1e6, 1.28e7, 1e9, 1e20 };
+	lm_m4 m, inv, expect;
+	size_t i;
+
+	for (i = 0; i < sizeof(trans) / sizeof(*trans); ++i) {
+		lm_m4_identity(m);
+		lm_m4_translate(m, LM_V3(trans[i], -trans[i], trans[i]));
+		lm_m4_identity(expect);
+		lm_m4_translate(expect, LM_V3(-trans[i], trans[i], -trans[i]));
+
+		assert(lm_m4_invert_dest(inv, m));
+		expect_m4(inv, expect, 0);
+		assert(lm_m4_invert_affine(inv, m));
+		expect_m4(inv, expect, 0);
+	}
+
+	lm_m4_identity(m);
+	m[0][0] = m[1][1] = m[2][2] = 1e-10;
+	assert(lm_m4_invert_dest(inv, m));
+	assert(fabsf(inv[0][0] - 1e10) <= 1e10 * FLT_EPSILON);
+
+	lm_m4_identity(m);
+	lm_v4_copy(m[1], LM_V4(2, 0, 0, 0));
+	assert(!lm_m4_invert_dest(inv, m));
+	assert(is_identity(inv));
+	assert(!lm_m4_invert_affine(inv, m));
+	assert(is_identity(inv));
+}
+
+/*
+ * Batch transformations
+ * The results are compared to \m * v in double precision. Packed destinations
+ * at every offset from 16 byte alignment, strided destinations and in place
+ * transformations take the single vector, the four vector block and the
+ * streaming paths. Bytes around and between the results must stay untouched.
+ */
+#define XFORM_MAX 400000
+#define XFORM_FILL 0xa5
+
+/* \dim components of the results at \dest equal \m * (v, \w) */
+static void expect_transformed(lm_m4 m, const uint8_t *dest,
+			size_t dest_stride, const uint8_t *src,
+			size_t src_stride, size_t num, size_t dim, lm_float w)
+{
+	lm_float v[4], r[4];
+	double sum, mag;
+	size_t i, j, k;
+
+	for (i = 0; i < num; ++i) {
+		memcpy(v, &src[i * src_stride], sizeof(lm_float) * dim);
+		if (dim == 3)
+			v[3] = w;
+		memcpy(r, &dest[i * dest_stride], sizeof(lm_float) * dim);
+
+		for (j = 0; j < dim; ++j) {
+			sum = mag = 0;
+			for (k = 0; k < 4; ++k) {
+				sum += (double)m[j][k] * v[k];
+				mag += fabs((double)m[j][k] * v[k]);
+			}
+			assert(fabs(r[j] - sum) <= mag * 1e-6);
+		}
+	}
+}
+
+/* the \n bytes at \buf were not written */
+static void expect_untouched(const uint8_t *buf, size_t n)
+{
+	while (n--)
+		assert(buf[n] == XFORM_FILL);
+}
+
+static void test_transform_num(lm_m4 m, uint8_t *dest, const uint8_t *src,
+								size_t num)
+{
+	size_t off, i;
+
+	/* packed destinations, at 0, 4, 8 and 12 bytes from alignment */
+	for (off = 0; off < 16; off += 4) {
+		memset(dest, XFORM_FILL, off + num * 16 + 16);
+		lm_m4_transform_v3_array(m, dest + off, 0, src, 0, num);
+		expect_transformed(m, dest + off, 12, src, 12, num, 3, 1);
+		expect_untouched(dest, off);
+		expect_untouched(dest + off + num * 12, 16);
+
+		lm_m4_transform_v3_dir_array(m, dest + off, 0, src, 0, num);
+		expect_transformed(m, dest + off, 12, src, 12, num, 3, 0);
+		expect_untouched(dest + off + num * 12, 16);
+
+		lm_m4_transform_v4_array(m, dest + off, 0, src, 0, num);
+		expect_transformed(m, dest + off, 16, src, 16, num, 4, 0);
+		expect_untouched(dest, off);
+		expect_untouched(dest + off + num * 16, 16);
+	}
+
+	/* strided destination with padding, lm_v4 sources read as lm_v3 */
+	memset(dest, XFORM_FILL, num * 20 + 16);
+	lm_m4_transform_v3_array(m, dest, 20, src, 16, num);
+	expect_transformed(m, dest, 20, src, 16, num, 3, 1);
+	for (i = 0; i < num; ++i)
+		expect_untouched(dest + i * 20 + 12, 8);
+
+	memset(dest, XFORM_FILL, num * 32 + 16);
+	lm_m4_transform_v4_array(m, dest, 32, src, 16, num);
+	expect_transformed(m, dest, 32, src, 16, num, 4, 0);
+	for (i = 0; i < num; ++i)
+		expect_untouched(dest + i * 32 + 16, 16);
+
+	/* in place */
+	memcpy(dest, src, num * 12);
+	lm_m4_transform_v3_array(m, dest, 0, dest, 0, num);
+	expect_transformed(m, dest, 12, src, 12, num, 3, 1);
+
+	memcpy(dest, src, num * 16);
+	lm_m4_transform_v4_array(m, dest, 0, dest, 0, num);
+	expect_transformed(m, dest, 16, src, 16, num, 4, 0);
+}
+
+static void test_transform(void)
+{
+	static const size_t nums[] = {
+		0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 13, 100, XFORM_MAX,
+	};
+	uint8_t *src, *dest;
+	lm_float *f;
+	uint32_t x = 1;
+	lm_m4 m;
+	size_t i, j;
+
+	for (i = 0; i < 4; ++i)
+		for (j = 0; j < 4; ++j)
+			m[i][j] = (i * 4 + j) * 0.25 - 1.5 + (i == j);
+
+	src = aligned_alloc(64, XFORM_MAX * 16);
+	dest = aligned_alloc(64, XFORM_MAX * 32 + 64);
+	assert(src && dest);
+
+	f = (lm_float*)src;
+	for (i = 0; i < XFORM_MAX * 4; ++i) {
+		x = x * 1103515245 + 12345;
+		f[i] = (lm_float)(x >> 8) / (1 << 20) - 8;
+	}
+
+	for (i = 0; i < sizeof(nums) / sizeof(*nums); ++i)
+		test_transform_num(m, dest, src, nums[i]);
+
+	free(dest);
+	free(src);
+}
+
+/*
+ * Vector streams
+ * The batched functions are compared to the lm_v3 functions for counts that
+ * end inside a block. Scalar results must not be written past \num floats and
+ * strided stores must leave the padding alone. The destinations of cross and
+ * lerp are also one of their sources.
+ */
+#define SOA_SENTINEL -12345.0f
+
+static void expect_near(lm_float a, lm_float b)
+{
+	assert(fabsf(a - b) <= 1e-5f * (1 + fabsf(b)));
+}
+
+static void expect_v3_near(const lm_v3 a, const lm_v3 b)
+{
+	expect_near(a[0], b[0]);
+	expect_near(a[1], b[1]);
+	expect_near(a[2], b[2]);
+}
+
+static void test_soa_num(size_t num)
+{
+	struct lm_v3_soa a, b, d;
+	lm_v4 src_a[32], src_b[32], out[32 + 1];
+	lm_float res[32 + 8];
+	lm_v3 v, r;
+	size_t i;
+
+	assert(num <= 32);
+	for (i = 0; i < num; ++i) {
+		lm_v4_copy(src_a[i], LM_V4(i + 1, 0.5f * i - 3, 2 - 0.25f * i,
+								SOA_SENTINEL));
+		lm_v4_copy(src_b[i], LM_V4(0.75f * i, 1, i * i * 0.125f - 5,
+								SOA_SENTINEL));
+	}
+
+	assert(!lm_v3_soa_init(&a, num));
+	assert(!lm_v3_soa_init(&b, num));
+	assert(!lm_v3_soa_init(&d, num));
+	lm_v3_soa_load(&a, src_a, sizeof(lm_v4));
+	lm_v3_soa_load(&b, src_b, sizeof(lm_v4));
+
+	/* strided store keeps the fourth component */
+	for (i = 0; i <= num; ++i)
+		lm_v4_copy(out[i], LM_V4(0, 0, 0, SOA_SENTINEL));
+	lm_v3_soa_store(&a, out, sizeof(lm_v4));
+	for (i = 0; i < num; ++i) {
+		assert(!memcmp(out[i], src_a[i], sizeof(lm_v4)));
+		lm_v3_soa_get(&a, i, v);
+		assert(!memcmp(v, src_a[i], sizeof(lm_v3)));
+	}
+	assert(out[num][0] == 0 && out[num][3] == SOA_SENTINEL);
+
+	for (i = 0; i < num + 8; ++i)
+		res[i] = SOA_SENTINEL;
+	lm_v3_soa_dot(res, &a, &b);
+	for (i = 0; i < num; ++i)
+		expect_near(res[i], lm_v3_dot(src_a[i], src_b[i]));
+	for (i = num; i < num + 8; ++i)
+		assert(res[i] == SOA_SENTINEL);
+
+	lm_v3_soa_length(res, &b);
+	for (i = 0; i < num; ++i)
+		expect_near(res[i], lm_v3_length(src_b[i]));
+	for (i = num; i < num + 8; ++i)
+		assert(res[i] == SOA_SENTINEL);
+
+	lm_v3_soa_norm(&d, &a);
+	for (i = 0; i < num; ++i) {
+		lm_v3_soa_get(&d, i, v);
+		lm_v3_norm_dest(r, src_a[i]);
+		expect_v3_near(v, r);
+	}
+
+	lm_v3_soa_lerp(&b, &a, &b, 0.3f);
+	for (i = 0; i < num; ++i) {
+		lm_v3_soa_get(&b, i, v);
+		r[0] = src_a[i][0] + (src_b[i][0] - src_a[i][0]) * 0.3f;
+		r[1] = src_a[i][1] + (src_b[i][1] - src_a[i][1]) * 0.3f;
+		r[2] = src_a[i][2] + (src_b[i][2] - src_a[i][2]) * 0.3f;
+		expect_v3_near(v, r);
+		lm_v3_copy(src_b[i], v);
+	}
+
+	lm_v3_soa_cross(&a, &a, &b);
+	for (i = 0; i < num; ++i) {
+		lm_v3_soa_get(&a, i, v);
+		lm_v3_cross_dest(r, src_a[i], src_b[i]);
+		expect_v3_near(v, r);
+		lm_v3_copy(src_a[i], v);
+	}
+
+	lm_v3_soa_add(&a, &b);
+	lm_v3_soa_mult(&a, -2);
+	lm_v3_soa_store(&a, out, 0);
+	for (i = 0; i < num; ++i) {
+		lm_v3_copy(r, src_a[i]);
+		lm_v3_add(r, src_b[i]);
+		lm_v3_mult(r, -2);
+		memcpy(v, &((lm_float*)out)[i * 3], sizeof(v));
+		expect_v3_near(v, r);
+	}
+
+	lm_v3_soa_destroy(&d);
+	lm_v3_soa_destroy(&b);
+	lm_v3_soa_destroy(&a);
+}
+
+static void test_soa(void)
+{
+	static const size_t nums[] = { 0, 1, 3, 7, 8, 9, 15, 16, 17, 29 };
+	size_t i;
+
+	for (i = 0; i < sizeof(nums) / sizeof(*nums); ++i)
+		test_soa_num(nums[i]);
+}
+
+/*
+ * Quaternions
+ * Rotations are counter-clockwise: +90 degrees about z maps x to y.
+ * lm_m4_rotate() and lm_quat_mult() apply the new rotation first. The
+ * batched slerp must match the single quaternion functions for counts that
+ * are not a multiple of four, and the fast slerp must stay within 2e-3
+ * radians of the exact one.
+ */
+
+/* \m * (\v, 1) equals \expect */
+static void expect_maps(lm_m4 m, const lm_v3 v, const lm_v3 expect)
+{
+	lm_v3 r;
+
+	lm_m4_transform_v3_array(m, r, 0, v, 0, 1);
+	expect_v3_near(r, expect);
+}
+
+/* angle in radians between the rotations \a and \b */
+static lm_float quat_angle(const lm_quat a, const lm_quat b)
+{
+	lm_float d = fabsf(lm_v4_dot(a, b));
+
+	return 2 * acosf(d > 1 ? 1 : d);
+}
+
+static void test_quat(void)
+{
+	lm_quat q, r, qa[19], qb[19], out[19], ref[19];
+	lm_float t[19], angle;
+	lm_m4 m, rot;
+	lm_m3 m3;
+	size_t i, j, num;
+
+	lm_m4_identity(m);
+	lm_m4_rotate(m, M_PI / 2, LM_V3(0, 0, 1));
+	expect_maps(m, LM_V3(1, 0, 0), LM_V3(0, 1, 0));
+	expect_maps(m, LM_V3(0, 1, 0), LM_V3(-1, 0, 0));
+	expect_maps(m, LM_V3(0, 0, 1), LM_V3(0, 0, 1));
+
+	lm_m4_identity(m);
+	lm_m4_rotate(m, M_PI / 2, LM_V3(2, 0, 0));
+	expect_maps(m, LM_V3(0, 1, 0), LM_V3(0, 0, 1));
+	lm_m4_identity(m);
+	lm_m4_rotate(m, M_PI / 2, LM_V3(0, 3, 0));
+	expect_maps(m, LM_V3(0, 0, 1), LM_V3(1, 0, 0));
+
+	/* the rotation is applied before the translation */
+	lm_m4_identity(m);
+	lm_m4_translate(m, LM_V3(10, 0, 0));
+	lm_m4_rotate(m, M_PI / 2, LM_V3(0, 0, 1));
+	expect_maps(m, LM_V3(1, 0, 0), LM_V3(10, 1, 0));
+
+	/* null axis */
+	lm_quat_axis_angle(q, LM_V3_ZERO, 1);
+	assert(!memcmp(q, LM_QUAT_IDENTITY, sizeof(q)));
+
+	/* ri first: z maps x to y, then x maps y to z */
+	lm_quat_axis_angle(q, LM_V3(1, 0, 0), M_PI / 2);
+	lm_quat_axis_angle(r, LM_V3(0, 0, 1), M_PI / 2);
+	lm_quat_mult(q, q, r);
+	lm_quat_to_m4(m, q);
+	expect_maps(m, LM_V3(1, 0, 0), LM_V3(0, 0, 1));
+
+	lm_quat_to_m3(m3, q);
+	for (i = 0; i < 3; ++i) {
+		for (j = 0; j < 3; ++j)
+			expect_near(m3[i][j], m[i][j]);
+		expect_near(m[i][3], 0);
+		expect_near(m[3][i], 0);
+	}
+	expect_near(m[3][3], 1);
+
+	/* conjugate is the inverse */
+	lm_quat_to_m4(rot, q);
+	lm_quat_conj(q);
+	lm_quat_to_m4(m, q);
+	lm_m4_mult_post(m, rot);
+	lm_m4_identity(rot);
+	expect_m4(m, rot, 1e-6);
+
+	/* halfway between 0 and 90 degrees about z, also via -b */
+	lm_quat_identity(q);
+	lm_quat_axis_angle(r, LM_V3(0, 0, 1), M_PI / 2);
+	lm_quat_slerp(out[0], q, r, 0.5);
+	lm_v4_mult(r, -1);
+	lm_quat_slerp(out[1], q, r, 0.5);
+	lm_quat_axis_angle(ref[0], LM_V3(0, 0, 1), M_PI / 4);
+	assert(quat_angle(out[0], ref[0]) < 1e-3);
+	assert(quat_angle(out[1], ref[0]) < 1e-3);
+	lm_quat_slerp(out[0], q, r, 0);
+	assert(quat_angle(out[0], q) < 1e-3);
+	lm_quat_slerp(out[0], q, r, 1);
+	assert(quat_angle(out[0], r) < 1e-3);
+
+	/* pairs up to 170 degrees apart at times across [0, 1] */
+	for (i = 0; i < 19; ++i) {
+		angle = i * M_PI / 19 * 0.95;
+		lm_quat_axis_angle(qa[i], LM_V3(1, i, 2), 0.1 * i);
+		lm_quat_axis_angle(r, LM_V3(i, -1, 1), angle);
+		lm_quat_mult(qb[i], r, qa[i]);
+		t[i] = (i * 7 % 19) / 18.0;
+	}
+
+	for (num = 0; num <= 19; ++num) {
+		lm_quat_slerp_array(out, qa, qb, t, num, true);
+		for (i = 0; i < num; ++i) {
+			lm_quat_slerp_fast(ref[i], qa[i], qb[i], t[i]);
+			for (j = 0; j < 4; ++j)
+				assert(fabsf(out[i][j] - ref[i][j]) <= 1e-6);
+			lm_quat_slerp(ref[i], qa[i], qb[i], t[i]);
+			assert(quat_angle(out[i], ref[i]) <= 2e-3);
+		}
+
+		lm_quat_slerp_array(out, qa, qb, t, num, false);
+		for (i = 0; i < num; ++i) {
+			lm_quat_slerp(ref[i], qa[i], qb[i], t[i]);
+			assert(!memcmp(out[i], ref[i], sizeof(lm_quat)));
+		}
+	}
+}
+
 int main()
 {
 	lm_m4 m, i, d;
@@ -21,5 +443,11 @@ int main()
 	lm_m4_print("", i);
 	lm_m4_print("", d);
 
+	test_invert();
+	test_transform();
+	test_soa();
+	test_quat();
+	printf("ok\n");
+
 	return 0;
 }
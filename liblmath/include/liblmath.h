@@ -11,16 +11,25 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
 /*
  * Basic floating point type
- * lm_float is used as generic floating point type all over the library. If we
- * want to convert the library to use double prevision, we only need to change
- * this type.
- * We use single-precision to be compatible with OpenGL.
+ * lm_float is used as generic floating point type all over the library.
+ * We use single-precision to be compatible with OpenGL. The SSE and AVX code
+ * paths use single-precision intrinsics, so converting the library to double
+ * precision requires porting them, too. The assertion below catches attempts to
+ * only change this type.
  */
 
 typedef float lm_float;
 
+_Static_assert(sizeof(lm_float) == 4, "SIMD code requires 32bit lm_float");
+
 /*
  * Vectors
  * 3 and 4 dimensional vectors are supported. Most functions are pretty simple
@@ -33,6 +42,15 @@ typedef float lm_float;
 typedef lm_float lm_v3[3];
 typedef lm_float lm_v4[4];
 
+/*
+ * Aligned vectors
+ * lm_v4a is an lm_v4 aligned to 16 bytes so it fits into a single SSE register
+ * without crossing a cache line. It can be used everywhere an lm_v4 is
+ * requested.
+ */
+
+typedef lm_float lm_v4a[4] __attribute__((aligned(16)));
+
 #define LM_V3(x, y, z) ((lm_v3) { (x), (y), (z) })
 #define LM_V4(x, y, z, w) ((lm_v4) { (x), (y), (z), (w) })
 
@@ -76,12 +94,24 @@ static inline void lm_v4_norm_dest(lm_v4 dest, const lm_v4 src);
  * binary compatible so you cant use M4 where M3 is requested unless you know
  * what you're doing.
  * You may use all functions with column-major matrices, too. All functions work
- * the same on any matrix layout.
+ * the same on any matrix layout. Only lm_m4_translate(), lm_m4_invert_affine()
+ * and lm_m4_invert_rigid() expect the translation in the fourth column.
+ * Matrices can be inverted in place, dest may be the same as src.
  */
 
 typedef lm_float lm_m3[3][3];
 typedef lm_float lm_m4[4][4];
 
+/*
+ * Aligned matrices
+ * lm_m4a is an lm_m4 aligned to 64 bytes so the whole matrix fills exactly one
+ * cache line and every two rows fit into an aligned AVX register. It can be
+ * used everywhere an lm_m4 is requested. The matrix functions accept unaligned
+ * matrices, too, but are faster on aligned ones.
+ */
+
+typedef lm_float lm_m4a[4][4] __attribute__((aligned(64)));
+
 static inline void lm_m3_copy(lm_m3 dest, lm_m3 src);
 static inline void lm_m3_identity(lm_m3 dest);
 static inline void lm_m3_transpose(lm_m3 dest);
@@ -99,6 +129,110 @@ static inline void lm_m4_mult_pre(lm_m4 dest, lm_m4 pre);
 static inline void lm_m4_mult_post(lm_m4 dest, lm_m4 post);
 static inline bool lm_m4_invert(lm_m4 dest);
 extern bool lm_m4_invert_dest(lm_m4 dest, lm_m4 src);
+extern bool lm_m4_invert_affine(lm_m4 dest, lm_m4 src);
+extern void lm_m4_invert_rigid(lm_m4 dest, lm_m4 src);
+
+/*
+ * Batch Transformations
+ * Multiply \num vectors at \src with \m and store the results at \dest.
+ * Strides are in bytes and 0 means tightly packed. The v3 variants transform
+ * points (w = 1) and directions (w = 0).
+ */
+
+extern void lm_m4_transform_v4_array(lm_m4 m, void *dest, size_t dest_stride,
+			const void *src, size_t src_stride, size_t num);
+extern void lm_m4_transform_v3_array(lm_m4 m, void *dest, size_t dest_stride,
+			const void *src, size_t src_stride, size_t num);
+extern void lm_m4_transform_v3_dir_array(lm_m4 m, void *dest,
+			size_t dest_stride, const void *src, size_t src_stride,
+								size_t num);
+
+/*
+ * Vector Streams
+ * A struct lm_v3_soa stores \num 3 dimensional vectors in blocks of
+ * LM_SOA_WIDTH vectors. Every block keeps all x, all y and all z components in
+ * separate arrays so the batched functions work on whole SIMD registers of
+ * vectors at once. Unused lanes of the last block are undefined.
+ * lm_v3_soa_load() and lm_v3_soa_store() convert from and to arrays of vectors
+ * with a stride in bytes, 0 means an array of lm_v3.
+ * All streams passed to the same batched function must have the same length.
+ * The destination may be one of the sources. Scalar results are written to
+ * plain arrays of \num floats.
+ */
+
+#define LM_SOA_WIDTH 8
+
+struct lm_v3_block {
+	lm_float x[LM_SOA_WIDTH];
+	lm_float y[LM_SOA_WIDTH];
+	lm_float z[LM_SOA_WIDTH];
+} __attribute__((aligned(32)));
+
+struct lm_v3_soa {
+	struct lm_v3_block *blocks;
+	size_t num;
+};
+
+extern int lm_v3_soa_init(struct lm_v3_soa *soa, size_t num);
+extern void lm_v3_soa_destroy(struct lm_v3_soa *soa);
+extern void lm_v3_soa_load(struct lm_v3_soa *soa, const void *src,
+								size_t stride);
+extern void lm_v3_soa_store(const struct lm_v3_soa *soa, void *dest,
+								size_t stride);
+static inline void lm_v3_soa_get(const struct lm_v3_soa *soa, size_t i,
+								lm_v3 dest);
+static inline void lm_v3_soa_set(struct lm_v3_soa *soa, size_t i,
+							const lm_v3 src);
+
+extern void lm_v3_soa_add(struct lm_v3_soa *dest,
+					const struct lm_v3_soa *addend);
+extern void lm_v3_soa_mult(struct lm_v3_soa *dest, lm_float factor);
+extern void lm_v3_soa_dot(lm_float *dest, const struct lm_v3_soa *a,
+						const struct lm_v3_soa *b);
+extern void lm_v3_soa_cross(struct lm_v3_soa *dest, const struct lm_v3_soa *a,
+						const struct lm_v3_soa *b);
+extern void lm_v3_soa_length(lm_float *dest, const struct lm_v3_soa *src);
+extern void lm_v3_soa_norm(struct lm_v3_soa *dest,
+					const struct lm_v3_soa *src);
+extern void lm_v3_soa_lerp(struct lm_v3_soa *dest, const struct lm_v3_soa *a,
+				const struct lm_v3_soa *b, lm_float t);
+
+/*
+ * Quaternions
+ * A quaternion is stored as (x, y, z, w) where w is the real part. It is binary
+ * compatible with lm_v4 so lm_v4_dot(), lm_v4_norm() and friends can be used
+ * on it, too. Rotations are unit quaternions, angles are given in radians.
+ * lm_quat_mult() concatenates rotations like lm_m4_mult(): the result rotates
+ * by \ri first and then by \le.
+ * lm_quat_slerp() interpolates with constant angular velocity.
+ * lm_quat_slerp_fast() corrects the interpolation parameter of lm_quat_nlerp()
+ * with a polynomial instead and stays within 2e-3 radians of it without
+ * any trigonometric functions. Both take the shortest path.
+ * lm_quat_slerp_array() interpolates \num pairs of quaternions at once, for
+ * instance all channels of an animation at their sample times.
+ */
+
+typedef lm_float lm_quat[4];
+
+#define LM_QUAT(x, y, z, w) ((lm_quat) { (x), (y), (z), (w) })
+#define LM_QUAT_IDENTITY LM_QUAT(0, 0, 0, 1)
+
+static inline void lm_quat_identity(lm_quat dest);
+static inline void lm_quat_conj(lm_quat dest);
+static inline void lm_quat_mult(lm_quat dest, const lm_quat le,
+							const lm_quat ri);
+extern void lm_quat_axis_angle(lm_quat dest, const lm_v3 axis, lm_float angle);
+extern void lm_quat_nlerp(lm_quat dest, const lm_quat a, const lm_quat b,
+								lm_float t);
+extern void lm_quat_slerp(lm_quat dest, const lm_quat a, const lm_quat b,
+								lm_float t);
+extern void lm_quat_slerp_fast(lm_quat dest, const lm_quat a, const lm_quat b,
+								lm_float t);
+extern void lm_quat_slerp_array(lm_quat *dest, const lm_quat *a,
+				const lm_quat *b, const lm_float *t, size_t num,
+								bool fast);
+extern void lm_quat_to_m3(lm_m3 dest, const lm_quat src);
+extern void lm_quat_to_m4(lm_m4 dest, const lm_quat src);
 
 /*
  * Matrix Stack
@@ -323,11 +457,102 @@ static inline void lm_m4_translate(lm_m4 dest, const lm_v3 src)
 	dest[2][3] += src[2];
 }
 
+/* dest = dest * R where R rotates by \angle radians around \axis */
 static inline void lm_m4_rotate(lm_m4 dest, lm_float angle, const lm_v3 axis)
 {
-	assert(0);
+	lm_quat q;
+	lm_m4 rot;
+
+	lm_quat_axis_angle(q, axis, angle);
+	lm_quat_to_m4(rot, q);
+	lm_m4_mult_post(dest, rot);
+}
+
+/*
+ * Matrix multiplication
+ * With SSE or AVX enabled, all rows of \ri are kept in registers and every
+ * result row is the sum of the rows of \ri scaled by the elements of the
+ * matching row of \le. AVX computes two result rows at once and uses fused
+ * multiply-add if available. All of \ri and each row of \le are read before
+ * the matching row of \dest is written, so \dest may be the same matrix as
+ * \le or \ri and lm_m4_mult_pre() and lm_m4_mult_post() need no temporary
+ * copy. Without SSE a scalar loop is used and \dest must not overlap.
+ */
+
+#if defined(__AVX__)
+
+static inline __m256 lm__madd256(__m256 a, __m256 b, __m256 c)
+{
+#ifdef __FMA__
+	return _mm256_fmadd_ps(a, b, c);
+#else
+	return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+
+/* loads one row into both halves of the register */
+static inline __m256 lm__load_row256(const lm_v4 row)
+{
+	__m128 v = _mm_loadu_ps(row);
+
+	return _mm256_insertf128_ps(_mm256_castps128_ps256(v), v, 1);
+}
+
+static inline __m256 lm__m4_mult_rows(__m256 l, __m256 r0, __m256 r1,
+							__m256 r2, __m256 r3)
+{
+	__m256 v;
+
+	v = _mm256_mul_ps(_mm256_permute_ps(l, 0x00), r0);
+	v = lm__madd256(_mm256_permute_ps(l, 0x55), r1, v);
+	v = lm__madd256(_mm256_permute_ps(l, 0xaa), r2, v);
+	return lm__madd256(_mm256_permute_ps(l, 0xff), r3, v);
+}
+
+static inline void lm_m4_mult(lm_m4 dest, lm_m4 le, lm_m4 ri)
+{
+	__m256 r0, r1, r2, r3, l01, l23;
+
+	r0 = lm__load_row256(ri[0]);
+	r1 = lm__load_row256(ri[1]);
+	r2 = lm__load_row256(ri[2]);
+	r3 = lm__load_row256(ri[3]);
+
+	l01 = _mm256_loadu_ps(le[0]);
+	l23 = _mm256_loadu_ps(le[2]);
+	_mm256_storeu_ps(dest[0], lm__m4_mult_rows(l01, r0, r1, r2, r3));
+	_mm256_storeu_ps(dest[2], lm__m4_mult_rows(l23, r0, r1, r2, r3));
+}
+
+#elif defined(__SSE__)
+
+static inline __m128 lm__m4_mult_row(const lm_v4 l, __m128 r0, __m128 r1,
+							__m128 r2, __m128 r3)
+{
+	__m128 v;
+
+	v = _mm_mul_ps(_mm_set1_ps(l[0]), r0);
+	v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(l[1]), r1));
+	v = _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(l[2]), r2));
+	return _mm_add_ps(v, _mm_mul_ps(_mm_set1_ps(l[3]), r3));
+}
+
+static inline void lm_m4_mult(lm_m4 dest, lm_m4 le, lm_m4 ri)
+{
+	__m128 r0, r1, r2, r3;
+	size_t i;
+
+	r0 = _mm_loadu_ps(ri[0]);
+	r1 = _mm_loadu_ps(ri[1]);
+	r2 = _mm_loadu_ps(ri[2]);
+	r3 = _mm_loadu_ps(ri[3]);
+
+	for (i = 0; i < 4; ++i)
+		_mm_storeu_ps(dest[i], lm__m4_mult_row(le[i], r0, r1, r2, r3));
 }
 
+#else
+
 static inline void lm_m4_mult(lm_m4 dest, lm_m4 le, lm_m4 ri)
 {
 	size_t i, j;
@@ -343,30 +568,79 @@ static inline void lm_m4_mult(lm_m4 dest, lm_m4 le, lm_m4 ri)
 	}
 }
 
+#endif
+
 static inline void lm_m4_mult_pre(lm_m4 dest, lm_m4 pre)
 {
+#ifdef __SSE__
+	lm_m4_mult(dest, pre, dest);
+#else
 	lm_m4 tmp;
 
 	lm_m4_mult(tmp, pre, dest);
 	lm_m4_copy(dest, tmp);
+#endif
 }
 
 static inline void lm_m4_mult_post(lm_m4 dest, lm_m4 post)
 {
+#ifdef __SSE__
+	lm_m4_mult(dest, dest, post);
+#else
 	lm_m4 tmp;
 
 	lm_m4_mult(tmp, dest, post);
 	lm_m4_copy(dest, tmp);
+#endif
 }
 
 static inline bool lm_m4_invert(lm_m4 dest)
 {
-	lm_m4 tmp;
-	bool ret;
+	return lm_m4_invert_dest(dest, dest);
+}
 
-	ret = lm_m4_invert_dest(tmp, dest);
-	lm_m4_copy(dest, tmp);
-	return ret;
+static inline void lm_v3_soa_get(const struct lm_v3_soa *soa, size_t i,
+								lm_v3 dest)
+{
+	const struct lm_v3_block *b = &soa->blocks[i / LM_SOA_WIDTH];
+
+	i %= LM_SOA_WIDTH;
+	lm_v3_copy(dest, LM_V3(b->x[i], b->y[i], b->z[i]));
+}
+
+static inline void lm_v3_soa_set(struct lm_v3_soa *soa, size_t i,
+							const lm_v3 src)
+{
+	struct lm_v3_block *b = &soa->blocks[i / LM_SOA_WIDTH];
+
+	i %= LM_SOA_WIDTH;
+	b->x[i] = src[0];
+	b->y[i] = src[1];
+	b->z[i] = src[2];
+}
+
+static inline void lm_quat_identity(lm_quat dest)
+{
+	lm_v4_copy(dest, LM_QUAT_IDENTITY);
+}
+
+static inline void lm_quat_conj(lm_quat dest)
+{
+	dest[0] = -dest[0];
+	dest[1] = -dest[1];
+	dest[2] = -dest[2];
+}
+
+static inline void lm_quat_mult(lm_quat dest, const lm_quat le,
+							const lm_quat ri)
+{
+	lm_quat tmp;
+
+	tmp[0] = le[3] * ri[0] + le[0] * ri[3] + le[1] * ri[2] - le[2] * ri[1];
+	tmp[1] = le[3] * ri[1] - le[0] * ri[2] + le[1] * ri[3] + le[2] * ri[0];
+	tmp[2] = le[3] * ri[2] + le[0] * ri[1] - le[1] * ri[0] + le[2] * ri[3];
+	tmp[3] = le[3] * ri[3] - le[0] * ri[0] - le[1] * ri[1] - le[2] * ri[2];
+	lm_v4_copy(dest, tmp);
 }
 
 static inline bool lm_stack_is_root(struct lm_stack *stack)
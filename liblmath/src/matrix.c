@@ -15,14 +15,9 @@
 #include <string.h>
 #include "liblmath.h"
 
-static inline void swapf(lm_float *a, lm_float *b)
-{
-	lm_float tmp;
-
-	tmp = *a;
-	*a = *b;
-	*b = tmp;
-}
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
 
 void lm_m4_print(const char *prefix, lm_m4 src)
 {
@@ -34,60 +29,278 @@ void lm_m4_print(const char *prefix, lm_m4 src)
 	printf("\n");
 }
 
-bool lm_m4_invert_dest(lm_m4 dest, lm_m4 src)
+/*
+ * Matrix Inversion
+ * General matrices are inverted with the adjugate: every element of the
+ * inverse is a cofactor of the source divided by its determinant. The
+ * cofactors are built from the determinants of 2x2 sub-matrices which are
+ * shared between them, so no pivoting and only one division is needed.
+ * With SSE the matrix is split into four 2x2 blocks which are each kept in one
+ * register and the inverse is assembled blockwise.
+ *
+ * A matrix is reported as singular if the absolute value of its determinant is
+ * not bigger than FLT_EPSILON times the smaller of the products of its row
+ * norms and of its column norms. Both products bound the determinant
+ * (Hadamard), so the test is independent of the scale of the matrix. The
+ * determinant of a matrix with (0, 0, 0, 1) as fourth row is the one of its
+ * upper-left 3x3 matrix, so only that is bounded and translations of any size
+ * do not matter. dest is set to the identity if the matrix is singular.
+ */
+
+/* smaller Hadamard bound of the upper-left \n x \n matrix of \m */
+static lm_float det_bound(lm_m4 m, size_t n)
 {
-	lm_m4 mat;
-	size_t i, j, k, index;
-	lm_float value;
-
-	/* copy source so we can swap columns in it */
-	lm_m4_copy(mat, src);
-	lm_m4_identity(dest);
-
-	for (i = 0; i < 4; ++i) {
-		index = i;
-		value = mat[i][i];
-
-		for (j = i + 1; j < 4; ++j) {
-			if (fabs(value) < fabs(mat[i][j])) {
-				index = j;
-				value = mat[i][j];
-			}
-		}
+	lm_float rows = 1, cols = 1, r, c;
+	size_t i, j;
 
-		/* return identity for singular matrices */
-		if (fabs(value) <= FLT_EPSILON) {
-			lm_m4_identity(dest);
-			return false;
+	for (i = 0; i < n; ++i) {
+		r = 0;
+		c = 0;
+		for (j = 0; j < n; ++j) {
+			r += m[i][j] * m[i][j];
+			c += m[j][i] * m[j][i];
 		}
+		rows *= sqrtf(r);
+		cols *= sqrtf(c);
+	}
 
-		/* swap col to required pos */
-		if (i != index) {
-			for (j = 0; j < 4; ++j) {
-				swapf(&dest[j][i], &dest[j][index]);
-				swapf(&mat[j][i], &mat[j][index]);
-			}
-		}
+	return rows < cols ? rows : cols;
+}
 
-		for (j = 0; j < 4; j++) {
-			mat[j][i] *= 1.0 / value;
-			dest[j][i] *= 1.0 / value;
-		}
+/* determinant bound of \m which ignores the translation of affine matrices */
+static lm_float m4_bound(lm_m4 m)
+{
+	if (m[3][0] == 0 && m[3][1] == 0 && m[3][2] == 0 && m[3][3] == 1)
+		return det_bound(m, 3);
 
-		for (j = 0; j < 4; j++) {
-			if (j != i) {
-				value = mat[i][j];
-				for (k = 0; k < 4; ++k) {
-					mat[k][j] -= mat[k][i] * value;
-					dest[k][j] -= dest[k][i] * value;
-				}
-			}
-		}
+	return det_bound(m, 4);
+}
+
+static inline bool is_singular(lm_float det, lm_float bound)
+{
+	return !(fabsf(det) > FLT_EPSILON * bound);
+}
+
+#ifdef __SSE__
+
+#define SHUF(a, b, x, y, z, w) \
+		_mm_shuffle_ps((a), (b), _MM_SHUFFLE((w), (z), (y), (x)))
+#define SWIZ(a, x, y, z, w) SHUF((a), (a), (x), (y), (z), (w))
+
+/* 2x2 blocks are stored row-major as (m00, m01, m10, m11) */
+
+/* a * b */
+static inline __m128 m2_mult(__m128 a, __m128 b)
+{
+	return _mm_add_ps(_mm_mul_ps(a, SWIZ(b, 0, 3, 0, 3)),
+			_mm_mul_ps(SWIZ(a, 1, 0, 3, 2), SWIZ(b, 2, 1, 2, 1)));
+}
+
+/* adj(a) * b */
+static inline __m128 m2_adj_mult(__m128 a, __m128 b)
+{
+	return _mm_sub_ps(_mm_mul_ps(SWIZ(a, 3, 3, 0, 0), b),
+			_mm_mul_ps(SWIZ(a, 1, 1, 2, 2), SWIZ(b, 2, 3, 0, 1)));
+}
+
+/* a * adj(b) */
+static inline __m128 m2_mult_adj(__m128 a, __m128 b)
+{
+	return _mm_sub_ps(_mm_mul_ps(a, SWIZ(b, 3, 0, 3, 0)),
+			_mm_mul_ps(SWIZ(a, 1, 0, 3, 2), SWIZ(b, 2, 1, 2, 1)));
+}
+
+bool lm_m4_invert_dest(lm_m4 dest, lm_m4 src)
+{
+	__m128 r0, r1, r2, r3, a, b, c, d, dets, det_a, det_b, det_c, det_d;
+	__m128 ab, dc, x, y, z, w, det, tr;
+	lm_float fdet;
+
+	r0 = _mm_loadu_ps(src[0]);
+	r1 = _mm_loadu_ps(src[1]);
+	r2 = _mm_loadu_ps(src[2]);
+	r3 = _mm_loadu_ps(src[3]);
+
+	/* src = | a b |
+	 *       | c d | */
+	a = _mm_movelh_ps(r0, r1);
+	b = _mm_movehl_ps(r1, r0);
+	c = _mm_movelh_ps(r2, r3);
+	d = _mm_movehl_ps(r3, r2);
+
+	/* (|a|, |b|, |c|, |d|) */
+	dets = _mm_sub_ps(_mm_mul_ps(SHUF(r0, r2, 0, 2, 0, 2),
+						SHUF(r1, r3, 1, 3, 1, 3)),
+			_mm_mul_ps(SHUF(r0, r2, 1, 3, 1, 3),
+						SHUF(r1, r3, 0, 2, 0, 2)));
+	det_a = SWIZ(dets, 0, 0, 0, 0);
+	det_b = SWIZ(dets, 1, 1, 1, 1);
+	det_c = SWIZ(dets, 2, 2, 2, 2);
+	det_d = SWIZ(dets, 3, 3, 3, 3);
+
+	ab = m2_adj_mult(a, b);
+	dc = m2_adj_mult(d, c);
+
+	/* adjugates of the blocks of the inverse */
+	x = _mm_sub_ps(_mm_mul_ps(det_d, a), m2_mult(b, dc));
+	w = _mm_sub_ps(_mm_mul_ps(det_a, d), m2_mult(c, ab));
+	y = _mm_sub_ps(_mm_mul_ps(det_b, c), m2_mult_adj(d, ab));
+	z = _mm_sub_ps(_mm_mul_ps(det_c, b), m2_mult_adj(a, dc));
+
+	/* |src| = |a| |d| + |b| |c| - tr(adj(a) b adj(d) c) */
+	tr = _mm_mul_ps(ab, SWIZ(dc, 0, 2, 1, 3));
+	tr = _mm_add_ps(tr, SWIZ(tr, 1, 0, 3, 2));
+	tr = _mm_add_ps(tr, SWIZ(tr, 2, 3, 0, 1));
+	det = _mm_add_ps(_mm_mul_ps(det_a, det_d), _mm_mul_ps(det_b, det_c));
+	det = _mm_sub_ps(det, tr);
+
+	fdet = _mm_cvtss_f32(det);
+	if (is_singular(fdet, m4_bound(src))) {
+		lm_m4_identity(dest);
+		return false;
 	}
 
+	det = _mm_div_ps(_mm_setr_ps(1, -1, -1, 1), det);
+	x = _mm_mul_ps(x, det);
+	y = _mm_mul_ps(y, det);
+	z = _mm_mul_ps(z, det);
+	w = _mm_mul_ps(w, det);
+
+	/* transpose the adjugates back into rows */
+	_mm_storeu_ps(dest[0], SHUF(x, y, 3, 1, 3, 1));
+	_mm_storeu_ps(dest[1], SHUF(x, y, 2, 0, 2, 0));
+	_mm_storeu_ps(dest[2], SHUF(z, w, 3, 1, 3, 1));
+	_mm_storeu_ps(dest[3], SHUF(z, w, 2, 0, 2, 0));
+
+	return true;
+}
+
+#else /* __SSE__ */
+
+bool lm_m4_invert_dest(lm_m4 dest, lm_m4 src)
+{
+	lm_float s0, s1, s2, s3, s4, s5, c0, c1, c2, c3, c4, c5, det;
+	lm_m4 m, inv;
+	size_t i, j;
+
+	lm_m4_copy(m, src);
+
+	/* 2x2 determinants of the upper and lower two rows */
+	s0 = m[0][0] * m[1][1] - m[1][0] * m[0][1];
+	s1 = m[0][0] * m[1][2] - m[1][0] * m[0][2];
+	s2 = m[0][0] * m[1][3] - m[1][0] * m[0][3];
+	s3 = m[0][1] * m[1][2] - m[1][1] * m[0][2];
+	s4 = m[0][1] * m[1][3] - m[1][1] * m[0][3];
+	s5 = m[0][2] * m[1][3] - m[1][2] * m[0][3];
+	c5 = m[2][2] * m[3][3] - m[3][2] * m[2][3];
+	c4 = m[2][1] * m[3][3] - m[3][1] * m[2][3];
+	c3 = m[2][1] * m[3][2] - m[3][1] * m[2][2];
+	c2 = m[2][0] * m[3][3] - m[3][0] * m[2][3];
+	c1 = m[2][0] * m[3][2] - m[3][0] * m[2][2];
+	c0 = m[2][0] * m[3][1] - m[3][0] * m[2][1];
+
+	det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+	if (is_singular(det, m4_bound(m))) {
+		lm_m4_identity(dest);
+		return false;
+	}
+
+	inv[0][0] = m[1][1] * c5 - m[1][2] * c4 + m[1][3] * c3;
+	inv[0][1] = -m[0][1] * c5 + m[0][2] * c4 - m[0][3] * c3;
+	inv[0][2] = m[3][1] * s5 - m[3][2] * s4 + m[3][3] * s3;
+	inv[0][3] = -m[2][1] * s5 + m[2][2] * s4 - m[2][3] * s3;
+	inv[1][0] = -m[1][0] * c5 + m[1][2] * c2 - m[1][3] * c1;
+	inv[1][1] = m[0][0] * c5 - m[0][2] * c2 + m[0][3] * c1;
+	inv[1][2] = -m[3][0] * s5 + m[3][2] * s2 - m[3][3] * s1;
+	inv[1][3] = m[2][0] * s5 - m[2][2] * s2 + m[2][3] * s1;
+	inv[2][0] = m[1][0] * c4 - m[1][1] * c2 + m[1][3] * c0;
+	inv[2][1] = -m[0][0] * c4 + m[0][1] * c2 - m[0][3] * c0;
+	inv[2][2] = m[3][0] * s4 - m[3][1] * s2 + m[3][3] * s0;
+	inv[2][3] = -m[2][0] * s4 + m[2][1] * s2 - m[2][3] * s0;
+	inv[3][0] = -m[1][0] * c3 + m[1][1] * c1 - m[1][2] * c0;
+	inv[3][1] = m[0][0] * c3 - m[0][1] * c1 + m[0][2] * c0;
+	inv[3][2] = -m[3][0] * s3 + m[3][1] * s1 - m[3][2] * s0;
+	inv[3][3] = m[2][0] * s3 - m[2][1] * s1 + m[2][2] * s0;
+
+	det = 1.0 / det;
+	for (i = 0; i < 4; ++i)
+		for (j = 0; j < 4; ++j)
+			dest[i][j] = inv[i][j] * det;
+
+	return true;
+}
+
+#endif /* __SSE__ */
+
+/*
+ * Affine inversion
+ * \src must have (0, 0, 0, 1) as fourth row like all matrices built with
+ * lm_m4_translate(). Only the upper-left 3x3 matrix is inverted, its inverse
+ * is the transposed matrix of the cross products of its rows divided by its
+ * determinant. The translation is transformed by it and negated.
+ * Singular matrices are reported like with lm_m4_invert_dest().
+ */
+bool lm_m4_invert_affine(lm_m4 dest, lm_m4 src)
+{
+	lm_v3 r0, r1, r2, c0, c1, c2, t;
+	lm_float det;
+	size_t i;
+
+	lm_v3_copy(r0, src[0]);
+	lm_v3_copy(r1, src[1]);
+	lm_v3_copy(r2, src[2]);
+	lm_v3_copy(t, LM_V3(src[0][3], src[1][3], src[2][3]));
+
+	lm_v3_cross_dest(c0, r1, r2);
+	lm_v3_cross_dest(c1, r2, r0);
+	lm_v3_cross_dest(c2, r0, r1);
+	det = lm_v3_dot(r0, c0);
+
+	if (is_singular(det, det_bound(src, 3))) {
+		lm_m4_identity(dest);
+		return false;
+	}
+
+	det = 1.0 / det;
+	lm_v3_mult(c0, det);
+	lm_v3_mult(c1, det);
+	lm_v3_mult(c2, det);
+
+	lm_v4_copy(dest[0], LM_V4(c0[0], c1[0], c2[0], 0));
+	lm_v4_copy(dest[1], LM_V4(c0[1], c1[1], c2[1], 0));
+	lm_v4_copy(dest[2], LM_V4(c0[2], c1[2], c2[2], 0));
+	lm_v4_copy(dest[3], LM_V4(0, 0, 0, 1));
+	for (i = 0; i < 3; ++i)
+		dest[i][3] = -lm_v3_dot(dest[i], t);
+
 	return true;
 }
 
+/*
+ * Rigid inversion
+ * \src must be a rotation followed by a translation, that is, the upper-left
+ * 3x3 matrix is orthonormal and the fourth row is (0, 0, 0, 1). The inverse is
+ * the transposed rotation and the translation rotated by it and negated. This
+ * cannot fail.
+ */
+void lm_m4_invert_rigid(lm_m4 dest, lm_m4 src)
+{
+	lm_m4 tmp;
+	lm_v3 t;
+	size_t i;
+
+	lm_v3_copy(t, LM_V3(src[0][3], src[1][3], src[2][3]));
+
+	lm_v4_copy(tmp[0], LM_V4(src[0][0], src[1][0], src[2][0], 0));
+	lm_v4_copy(tmp[1], LM_V4(src[0][1], src[1][1], src[2][1], 0));
+	lm_v4_copy(tmp[2], LM_V4(src[0][2], src[1][2], src[2][2], 0));
+	lm_v4_copy(tmp[3], LM_V4(0, 0, 0, 1));
+	for (i = 0; i < 3; ++i)
+		tmp[i][3] = -lm_v3_dot(tmp[i], t);
+
+	lm_m4_copy(dest, tmp);
+}
+
 void lm_stack_init(struct lm_stack *stack)
 {
 	lm_m4_identity(stack->tip);
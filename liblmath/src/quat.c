@@ -0,0 +1,228 @@
+/*
+ * Linear Math
+ * Written 2011 by David Herrmann
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * Quaternions
+ * lm_quat_slerp_fast() is a normalized lerp with a corrected interpolation
+ * parameter. nlerp moves too fast near the middle of the arc and too slow near
+ * its ends. The correction t' = t + t (t - 0.5) (t - 1) k stretches t along a
+ * cubic whose strength k depends on the angle between the rotations, given by
+ * the absolute value of their dot product d. k is fitted as a polynomial in d
+ * and (t - 0.5)^2. This needs no trigonometric functions and no branches, so
+ * lm_quat_slerp_array() computes it for four quaternions at once with SSE.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "liblmath.h"
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+/* quaternions closer than this are interpolated linearly by lm_quat_slerp() */
+#define SLERP_LINEAR (1.0f - 1e-5f)
+
+/*
+ * Quaternion from axis and angle
+ * \axis does not need to be normalized. If it is the null vector, the identity
+ * is returned.
+ */
+void lm_quat_axis_angle(lm_quat dest, const lm_v3 axis, lm_float angle)
+{
+	lm_float len, s;
+
+	len = lm_v3_length(axis);
+	if (len == 0) {
+		lm_quat_identity(dest);
+		return;
+	}
+
+	s = sinf(angle * 0.5f) / len;
+	lm_v4_copy(dest, LM_QUAT(axis[0] * s, axis[1] * s, axis[2] * s,
+						cosf(angle * 0.5f)));
+}
+
+/* dest = a * wa + b * wb */
+static inline void blend(lm_quat dest, const lm_quat a, const lm_quat b,
+						lm_float wa, lm_float wb)
+{
+	lm_v4_copy(dest, LM_QUAT(a[0] * wa + b[0] * wb, a[1] * wa + b[1] * wb,
+				a[2] * wa + b[2] * wb, a[3] * wa + b[3] * wb));
+}
+
+void lm_quat_nlerp(lm_quat dest, const lm_quat a, const lm_quat b, lm_float t)
+{
+	lm_float wb = lm_v4_dot(a, b) < 0 ? -t : t;
+
+	blend(dest, a, b, 1 - t, wb);
+	lm_v4_norm(dest);
+}
+
+void lm_quat_slerp(lm_quat dest, const lm_quat a, const lm_quat b, lm_float t)
+{
+	lm_float d, sign, theta, s;
+
+	d = lm_v4_dot(a, b);
+	sign = d < 0 ? -1 : 1;
+	d *= sign;
+
+	if (d > SLERP_LINEAR) {
+		lm_quat_nlerp(dest, a, b, t);
+		return;
+	}
+
+	theta = acosf(d);
+	s = 1 / sinf(theta);
+	blend(dest, a, b, sinf((1 - t) * theta) * s,
+					sign * sinf(t * theta) * s);
+}
+
+static inline lm_float slerp_fast_t(lm_float d, lm_float t)
+{
+	lm_float a, b, k;
+
+	a = 1.0904f + d * (-3.2452f + d * (3.55645f - d * 1.43519f));
+	b = 0.848013f + d * (-1.06021f + d * 0.215638f);
+	k = a * (t - 0.5f) * (t - 0.5f) + b;
+
+	return t + t * (t - 0.5f) * (t - 1) * k;
+}
+
+void lm_quat_slerp_fast(lm_quat dest, const lm_quat a, const lm_quat b,
+								lm_float t)
+{
+	lm_quat_nlerp(dest, a, b, slerp_fast_t(fabsf(lm_v4_dot(a, b)), t));
+}
+
+#ifdef __SSE__
+
+/* four quaternions at once, transposed into one register per component */
+static void slerp_fast4(lm_quat *dest, const lm_quat *a, const lm_quat *b,
+							const lm_float *t)
+{
+	__m128 ax, ay, az, aw, bx, by, bz, bw, d, sign, tt, th, k, p, q, len;
+	const __m128 half = _mm_set1_ps(0.5f), one = _mm_set1_ps(1.0f);
+
+	ax = _mm_loadu_ps(a[0]);
+	ay = _mm_loadu_ps(a[1]);
+	az = _mm_loadu_ps(a[2]);
+	aw = _mm_loadu_ps(a[3]);
+	_MM_TRANSPOSE4_PS(ax, ay, az, aw);
+	bx = _mm_loadu_ps(b[0]);
+	by = _mm_loadu_ps(b[1]);
+	bz = _mm_loadu_ps(b[2]);
+	bw = _mm_loadu_ps(b[3]);
+	_MM_TRANSPOSE4_PS(bx, by, bz, bw);
+
+	d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)),
+			_mm_add_ps(_mm_mul_ps(az, bz), _mm_mul_ps(aw, bw)));
+
+	/* take the shortest path by flipping b if the dot product is negative */
+	sign = _mm_and_ps(d, _mm_set1_ps(-0.0f));
+	d = _mm_xor_ps(d, sign);
+	bx = _mm_xor_ps(bx, sign);
+	by = _mm_xor_ps(by, sign);
+	bz = _mm_xor_ps(bz, sign);
+	bw = _mm_xor_ps(bw, sign);
+
+	/* same polynomial as slerp_fast_t() */
+	p = _mm_mul_ps(d, _mm_set1_ps(1.43519f));
+	p = _mm_mul_ps(d, _mm_sub_ps(_mm_set1_ps(3.55645f), p));
+	p = _mm_mul_ps(d, _mm_add_ps(_mm_set1_ps(-3.2452f), p));
+	p = _mm_add_ps(_mm_set1_ps(1.0904f), p);
+	q = _mm_mul_ps(d, _mm_set1_ps(0.215638f));
+	q = _mm_mul_ps(d, _mm_add_ps(_mm_set1_ps(-1.06021f), q));
+	q = _mm_add_ps(_mm_set1_ps(0.848013f), q);
+
+	tt = _mm_loadu_ps(t);
+	th = _mm_sub_ps(tt, half);
+	k = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(p, th), th), q);
+	k = _mm_mul_ps(_mm_mul_ps(tt, th), _mm_mul_ps(_mm_sub_ps(tt, one), k));
+	tt = _mm_add_ps(tt, k);
+
+	/* a + (b - a) * t' */
+	ax = _mm_add_ps(ax, _mm_mul_ps(_mm_sub_ps(bx, ax), tt));
+	ay = _mm_add_ps(ay, _mm_mul_ps(_mm_sub_ps(by, ay), tt));
+	az = _mm_add_ps(az, _mm_mul_ps(_mm_sub_ps(bz, az), tt));
+	aw = _mm_add_ps(aw, _mm_mul_ps(_mm_sub_ps(bw, aw), tt));
+
+	len = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, ax), _mm_mul_ps(ay, ay)),
+			_mm_add_ps(_mm_mul_ps(az, az), _mm_mul_ps(aw, aw)));
+	len = _mm_div_ps(one, _mm_sqrt_ps(len));
+	ax = _mm_mul_ps(ax, len);
+	ay = _mm_mul_ps(ay, len);
+	az = _mm_mul_ps(az, len);
+	aw = _mm_mul_ps(aw, len);
+
+	_MM_TRANSPOSE4_PS(ax, ay, az, aw);
+	_mm_storeu_ps(dest[0], ax);
+	_mm_storeu_ps(dest[1], ay);
+	_mm_storeu_ps(dest[2], az);
+	_mm_storeu_ps(dest[3], aw);
+}
+
+#endif /* __SSE__ */
+
+/*
+ * Batched interpolation
+ * Sets dest[i] to the interpolation of a[i] and b[i] at t[i] for all \num
+ * entries. If \fast is true, lm_quat_slerp_fast() is used and four entries
+ * are computed at once if SSE is available, otherwise lm_quat_slerp().
+ * \dest may be the same array as \a or \b.
+ */
+void lm_quat_slerp_array(lm_quat *dest, const lm_quat *a, const lm_quat *b,
+				const lm_float *t, size_t num, bool fast)
+{
+	size_t i = 0;
+
+	if (fast) {
+#ifdef __SSE__
+		for ( ; i + 4 <= num; i += 4)
+			slerp_fast4(&dest[i], &a[i], &b[i], &t[i]);
+#endif
+		for ( ; i < num; ++i)
+			lm_quat_slerp_fast(dest[i], a[i], b[i], t[i]);
+	} else {
+		for ( ; i < num; ++i)
+			lm_quat_slerp(dest[i], a[i], b[i], t[i]);
+	}
+}
+
+/*
+ * Rotation matrices
+ * \src does not need to be normalized, the matrix is built for the rotation
+ * it represents. The matrices rotate column vectors like all matrices of this
+ * library.
+ */
+void lm_quat_to_m3(lm_m3 dest, const lm_quat src)
+{
+	lm_float x = src[0], y = src[1], z = src[2], w = src[3], s;
+
+	s = 2 / lm_v4_dot(src, src);
+
+	lm_v3_copy(dest[0], LM_V3(1 - s * (y * y + z * z), s * (x * y - z * w),
+							s * (x * z + y * w)));
+	lm_v3_copy(dest[1], LM_V3(s * (x * y + z * w), 1 - s * (x * x + z * z),
+							s * (y * z - x * w)));
+	lm_v3_copy(dest[2], LM_V3(s * (x * z - y * w), s * (y * z + x * w),
+						1 - s * (x * x + y * y)));
+}
+
+void lm_quat_to_m4(lm_m4 dest, const lm_quat src)
+{
+	lm_m3 rot;
+
+	lm_quat_to_m3(rot, src);
+	lm_v4_copy(dest[0], LM_V3TO4(rot[0], 0));
+	lm_v4_copy(dest[1], LM_V3TO4(rot[1], 0));
+	lm_v4_copy(dest[2], LM_V3TO4(rot[2], 0));
+	lm_v4_copy(dest[3], LM_V4(0, 0, 0, 1));
+}
@@ -0,0 +1,310 @@
+/*
+ * Linear Math
+ * Written 2011 by David Herrmann
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * Vector Streams
+ * The batched functions are written once against a small set of VEC_*
+ * macros which operate on VEC_WIDTH lanes at a time. With AVX these map to
+ * 8-lane registers, with SSE to 4-lane registers and otherwise to plain
+ * floats. Each block of LM_SOA_WIDTH vectors is processed as
+ * LM_SOA_WIDTH / VEC_WIDTH steps, so the kernels do not depend on the
+ * instruction set and blocks are always aligned for the widest one.
+ *
+ * Streams are allocated in whole blocks. Unused lanes of the last block are
+ * processed like all others, so scalar results of the last block are first
+ * written to a temporary block and only the used lanes are copied out.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "liblmath.h"
+
+#if defined(__AVX__)
+
+#include <immintrin.h>
+
+typedef __m256 vec;
+#define VEC_WIDTH 8
+#define VEC_LOAD(p) _mm256_load_ps(p)
+#define VEC_STORE(p, v) _mm256_store_ps((p), (v))
+#define VEC_SET1(f) _mm256_set1_ps(f)
+#define VEC_ADD(a, b) _mm256_add_ps((a), (b))
+#define VEC_SUB(a, b) _mm256_sub_ps((a), (b))
+#define VEC_MUL(a, b) _mm256_mul_ps((a), (b))
+#define VEC_DIV(a, b) _mm256_div_ps((a), (b))
+#define VEC_SQRT(a) _mm256_sqrt_ps(a)
+#ifdef __FMA__
+#define VEC_MADD(a, b, c) _mm256_fmadd_ps((a), (b), (c))
+#define VEC_MSUB(a, b, c) _mm256_fmsub_ps((a), (b), (c))
+#endif
+
+#elif defined(__SSE__)
+
+#include <xmmintrin.h>
+
+typedef __m128 vec;
+#define VEC_WIDTH 4
+#define VEC_LOAD(p) _mm_load_ps(p)
+#define VEC_STORE(p, v) _mm_store_ps((p), (v))
+#define VEC_SET1(f) _mm_set1_ps(f)
+#define VEC_ADD(a, b) _mm_add_ps((a), (b))
+#define VEC_SUB(a, b) _mm_sub_ps((a), (b))
+#define VEC_MUL(a, b) _mm_mul_ps((a), (b))
+#define VEC_DIV(a, b) _mm_div_ps((a), (b))
+#define VEC_SQRT(a) _mm_sqrt_ps(a)
+
+#else
+
+typedef lm_float vec;
+#define VEC_WIDTH 1
+#define VEC_LOAD(p) (*(p))
+#define VEC_STORE(p, v) (*(p) = (v))
+#define VEC_SET1(f) ((lm_float)(f))
+#define VEC_ADD(a, b) ((a) + (b))
+#define VEC_SUB(a, b) ((a) - (b))
+#define VEC_MUL(a, b) ((a) * (b))
+#define VEC_DIV(a, b) ((a) / (b))
+#define VEC_SQRT(a) sqrtf(a)
+
+#endif
+
+/* a * b + c and a * b - c */
+#ifndef VEC_MADD
+#define VEC_MADD(a, b, c) VEC_ADD(VEC_MUL((a), (b)), (c))
+#define VEC_MSUB(a, b, c) VEC_SUB(VEC_MUL((a), (b)), (c))
+#endif
+
+/* iterate over all lane groups \k of block \i of a stream with \num vectors */
+#define for_each_lanes(i, k, num) \
+	for (i = 0; i < soa_blocks(num); ++i) \
+		for (k = 0; k < LM_SOA_WIDTH; k += VEC_WIDTH)
+
+static inline size_t soa_blocks(size_t num)
+{
+	return (num + LM_SOA_WIDTH - 1) / LM_SOA_WIDTH;
+}
+
+static inline vec dot(const struct lm_v3_block *a, const struct lm_v3_block *b,
+								size_t k)
+{
+	vec v;
+
+	v = VEC_MUL(VEC_LOAD(&a->x[k]), VEC_LOAD(&b->x[k]));
+	v = VEC_MADD(VEC_LOAD(&a->y[k]), VEC_LOAD(&b->y[k]), v);
+	return VEC_MADD(VEC_LOAD(&a->z[k]), VEC_LOAD(&b->z[k]), v);
+}
+
+/* copies the used lanes of block \i of a scalar result to \dest */
+static void copy_out(lm_float *dest, const lm_float *block, size_t i,
+								size_t num)
+{
+	size_t n = num - i * LM_SOA_WIDTH;
+
+	if (n > LM_SOA_WIDTH)
+		n = LM_SOA_WIDTH;
+	memcpy(&dest[i * LM_SOA_WIDTH], block, n * sizeof(*dest));
+}
+
+int lm_v3_soa_init(struct lm_v3_soa *soa, size_t num)
+{
+	size_t size;
+	void *blocks;
+
+	soa->blocks = NULL;
+	soa->num = num;
+	if (!num)
+		return 0;
+
+	size = soa_blocks(num) * sizeof(*soa->blocks);
+	if (posix_memalign(&blocks, __alignof__(*soa->blocks), size))
+		return -ENOMEM;
+
+	memset(blocks, 0, size);
+	soa->blocks = blocks;
+	return 0;
+}
+
+void lm_v3_soa_destroy(struct lm_v3_soa *soa)
+{
+	free(soa->blocks);
+	soa->blocks = NULL;
+	soa->num = 0;
+}
+
+void lm_v3_soa_load(struct lm_v3_soa *soa, const void *src, size_t stride)
+{
+	const uint8_t *s = src;
+	lm_v3 v;
+	size_t i;
+
+	if (!stride)
+		stride = sizeof(lm_v3);
+
+	for (i = 0; i < soa->num; ++i, s += stride) {
+		memcpy(v, s, sizeof(v));
+		lm_v3_soa_set(soa, i, v);
+	}
+}
+
+void lm_v3_soa_store(const struct lm_v3_soa *soa, void *dest, size_t stride)
+{
+	uint8_t *d = dest;
+	lm_v3 v;
+	size_t i;
+
+	if (!stride)
+		stride = sizeof(lm_v3);
+
+	for (i = 0; i < soa->num; ++i, d += stride) {
+		lm_v3_soa_get(soa, i, v);
+		memcpy(d, v, sizeof(v));
+	}
+}
+
+void lm_v3_soa_add(struct lm_v3_soa *dest, const struct lm_v3_soa *addend)
+{
+	struct lm_v3_block *d;
+	const struct lm_v3_block *a;
+	size_t i, k;
+
+	assert(dest->num == addend->num);
+
+	for_each_lanes(i, k, dest->num) {
+		d = &dest->blocks[i];
+		a = &addend->blocks[i];
+		VEC_STORE(&d->x[k], VEC_ADD(VEC_LOAD(&d->x[k]),
+							VEC_LOAD(&a->x[k])));
+		VEC_STORE(&d->y[k], VEC_ADD(VEC_LOAD(&d->y[k]),
+							VEC_LOAD(&a->y[k])));
+		VEC_STORE(&d->z[k], VEC_ADD(VEC_LOAD(&d->z[k]),
+							VEC_LOAD(&a->z[k])));
+	}
+}
+
+void lm_v3_soa_mult(struct lm_v3_soa *dest, lm_float factor)
+{
+	struct lm_v3_block *d;
+	vec f = VEC_SET1(factor);
+	size_t i, k;
+
+	for_each_lanes(i, k, dest->num) {
+		d = &dest->blocks[i];
+		VEC_STORE(&d->x[k], VEC_MUL(VEC_LOAD(&d->x[k]), f));
+		VEC_STORE(&d->y[k], VEC_MUL(VEC_LOAD(&d->y[k]), f));
+		VEC_STORE(&d->z[k], VEC_MUL(VEC_LOAD(&d->z[k]), f));
+	}
+}
+
+void lm_v3_soa_dot(lm_float *dest, const struct lm_v3_soa *a,
+						const struct lm_v3_soa *b)
+{
+	struct lm_v3_block tmp;
+	size_t i, k;
+
+	assert(a->num == b->num);
+
+	for (i = 0; i < soa_blocks(a->num); ++i) {
+		for (k = 0; k < LM_SOA_WIDTH; k += VEC_WIDTH)
+			VEC_STORE(&tmp.x[k], dot(&a->blocks[i], &b->blocks[i],
+									k));
+		copy_out(dest, tmp.x, i, a->num);
+	}
+}
+
+void lm_v3_soa_cross(struct lm_v3_soa *dest, const struct lm_v3_soa *a,
+						const struct lm_v3_soa *b)
+{
+	const struct lm_v3_block *pa, *pb;
+	struct lm_v3_block *d;
+	vec ax, ay, az, bx, by, bz;
+	size_t i, k;
+
+	assert(dest->num == a->num && a->num == b->num);
+
+	for_each_lanes(i, k, dest->num) {
+		pa = &a->blocks[i];
+		pb = &b->blocks[i];
+		d = &dest->blocks[i];
+
+		ax = VEC_LOAD(&pa->x[k]);
+		ay = VEC_LOAD(&pa->y[k]);
+		az = VEC_LOAD(&pa->z[k]);
+		bx = VEC_LOAD(&pb->x[k]);
+		by = VEC_LOAD(&pb->y[k]);
+		bz = VEC_LOAD(&pb->z[k]);
+
+		VEC_STORE(&d->x[k], VEC_MSUB(ay, bz, VEC_MUL(az, by)));
+		VEC_STORE(&d->y[k], VEC_MSUB(az, bx, VEC_MUL(ax, bz)));
+		VEC_STORE(&d->z[k], VEC_MSUB(ax, by, VEC_MUL(ay, bx)));
+	}
+}
+
+void lm_v3_soa_length(lm_float *dest, const struct lm_v3_soa *src)
+{
+	struct lm_v3_block tmp;
+	const struct lm_v3_block *s;
+	size_t i, k;
+
+	for (i = 0; i < soa_blocks(src->num); ++i) {
+		s = &src->blocks[i];
+		for (k = 0; k < LM_SOA_WIDTH; k += VEC_WIDTH)
+			VEC_STORE(&tmp.x[k], VEC_SQRT(dot(s, s, k)));
+		copy_out(dest, tmp.x, i, src->num);
+	}
+}
+
+void lm_v3_soa_norm(struct lm_v3_soa *dest, const struct lm_v3_soa *src)
+{
+	const struct lm_v3_block *s;
+	struct lm_v3_block *d;
+	vec len;
+	size_t i, k;
+
+	assert(dest->num == src->num);
+
+	for_each_lanes(i, k, dest->num) {
+		s = &src->blocks[i];
+		d = &dest->blocks[i];
+
+		len = VEC_SQRT(dot(s, s, k));
+		VEC_STORE(&d->x[k], VEC_DIV(VEC_LOAD(&s->x[k]), len));
+		VEC_STORE(&d->y[k], VEC_DIV(VEC_LOAD(&s->y[k]), len));
+		VEC_STORE(&d->z[k], VEC_DIV(VEC_LOAD(&s->z[k]), len));
+	}
+}
+
+/* dest = a + (b - a) * t */
+void lm_v3_soa_lerp(struct lm_v3_soa *dest, const struct lm_v3_soa *a,
+				const struct lm_v3_soa *b, lm_float t)
+{
+	const struct lm_v3_block *pa, *pb;
+	struct lm_v3_block *d;
+	vec f = VEC_SET1(t), va;
+	size_t i, k;
+
+	assert(dest->num == a->num && a->num == b->num);
+
+	for_each_lanes(i, k, dest->num) {
+		pa = &a->blocks[i];
+		pb = &b->blocks[i];
+		d = &dest->blocks[i];
+
+		va = VEC_LOAD(&pa->x[k]);
+		VEC_STORE(&d->x[k], VEC_MADD(VEC_SUB(VEC_LOAD(&pb->x[k]), va),
+								f, va));
+		va = VEC_LOAD(&pa->y[k]);
+		VEC_STORE(&d->y[k], VEC_MADD(VEC_SUB(VEC_LOAD(&pb->y[k]), va),
+								f, va));
+		va = VEC_LOAD(&pa->z[k]);
+		VEC_STORE(&d->z[k], VEC_MADD(VEC_SUB(VEC_LOAD(&pb->z[k]), va),
+								f, va));
+	}
+}
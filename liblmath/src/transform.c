@@ -0,0 +1,248 @@
+/*
+ * Linear Math
+ * Written 2011 by David Herrmann
+ * Dedicated to the Public Domain
+ */
+
+/*
+ * Batch Transformations
+ * These multiply a whole array of vectors with one matrix. The vectors are
+ * taken as columns, that is, every result is \m * v. Strides are given in bytes
+ * like OpenGL vertex attribute strides so positions can be transformed in place
+ * inside of interleaved vertex buffers. A stride of 0 means the vectors are
+ * tightly packed. \dest may be the same buffer as \src if both use the same
+ * stride.
+ *
+ * With SSE the columns of the matrix are kept in registers for the whole array
+ * and every result is the sum of the columns scaled by the components of the
+ * source vector. Results that are written to a tightly packed and aligned
+ * destination are stored four vectors at a time. If the destination is bigger
+ * than LM_STREAM_MIN it would only evict the caches, so non-temporal stores
+ * are used then.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "liblmath.h"
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+/* destinations bigger than this bypass the caches */
+#define LM_STREAM_MIN (4 * 1024 * 1024)
+
+#ifdef __SSE__
+
+struct xform {
+	__m128 c0;
+	__m128 c1;
+	__m128 c2;
+	__m128 c3;
+};
+
+static inline void xform_init(struct xform *x, lm_m4 m)
+{
+	x->c0 = _mm_loadu_ps(m[0]);
+	x->c1 = _mm_loadu_ps(m[1]);
+	x->c2 = _mm_loadu_ps(m[2]);
+	x->c3 = _mm_loadu_ps(m[3]);
+	_MM_TRANSPOSE4_PS(x->c0, x->c1, x->c2, x->c3);
+}
+
+static inline __m128 xform_v4(const struct xform *x, __m128 v)
+{
+	__m128 r;
+
+	r = _mm_mul_ps(x->c0, _mm_shuffle_ps(v, v, 0x00));
+	r = _mm_add_ps(r, _mm_mul_ps(x->c1, _mm_shuffle_ps(v, v, 0x55)));
+	r = _mm_add_ps(r, _mm_mul_ps(x->c2, _mm_shuffle_ps(v, v, 0xaa)));
+	return _mm_add_ps(r, _mm_mul_ps(x->c3, _mm_shuffle_ps(v, v, 0xff)));
+}
+
+/* \w is the fourth column for points and zero for directions */
+static inline __m128 xform_v3(const struct xform *x, __m128 w,
+							const lm_float *src)
+{
+	__m128 r;
+
+	r = _mm_add_ps(w, _mm_mul_ps(x->c0, _mm_load1_ps(&src[0])));
+	r = _mm_add_ps(r, _mm_mul_ps(x->c1, _mm_load1_ps(&src[1])));
+	return _mm_add_ps(r, _mm_mul_ps(x->c2, _mm_load1_ps(&src[2])));
+}
+
+static inline void store_v3(lm_float *dest, __m128 v)
+{
+	_mm_storel_pi((__m64*)dest, v);
+	_mm_store_ss(&dest[2], _mm_movehl_ps(v, v));
+}
+
+void lm_m4_transform_v4_array(lm_m4 m, void *dest, size_t dest_stride,
+			const void *src, size_t src_stride, size_t num)
+{
+	struct xform x;
+	uint8_t *d = dest;
+	const uint8_t *s = src;
+	size_t i;
+
+	if (!dest_stride)
+		dest_stride = sizeof(lm_v4);
+	if (!src_stride)
+		src_stride = sizeof(lm_v4);
+
+	xform_init(&x, m);
+
+	if (dest_stride == sizeof(lm_v4) && !((uintptr_t)d & 15) &&
+				num * sizeof(lm_v4) >= LM_STREAM_MIN) {
+		for (i = 0; i < num; ++i, d += dest_stride, s += src_stride)
+			_mm_stream_ps((lm_float*)d,
+				xform_v4(&x, _mm_loadu_ps((const lm_float*)s)));
+		_mm_sfence();
+	} else {
+		for (i = 0; i < num; ++i, d += dest_stride, s += src_stride)
+			_mm_storeu_ps((lm_float*)d,
+				xform_v4(&x, _mm_loadu_ps((const lm_float*)s)));
+	}
+}
+
+static void transform_v3(lm_m4 m, void *dest, size_t dest_stride,
+			const void *src, size_t src_stride, size_t num,
+								bool point)
+{
+	struct xform x;
+	__m128 w, r0, r1, r2, r3, t;
+	uint8_t *d = dest;
+	const uint8_t *s = src;
+	size_t i = 0;
+	bool stream;
+
+	if (!dest_stride)
+		dest_stride = sizeof(lm_v3);
+	if (!src_stride)
+		src_stride = sizeof(lm_v3);
+
+	xform_init(&x, m);
+	w = point ? x.c3 : _mm_setzero_ps();
+
+	/*
+	 * Packed destinations are written in blocks of four vectors which are
+	 * exactly three aligned registers. Single vectors are written until
+	 * the destination is aligned.
+	 */
+	if (dest_stride == sizeof(lm_v3) && !((uintptr_t)d & 3)) {
+		for ( ; i < num && ((uintptr_t)d & 15); ++i) {
+			store_v3((lm_float*)d, xform_v3(&x, w,
+							(const lm_float*)s));
+			d += dest_stride;
+			s += src_stride;
+		}
+
+		stream = (num - i) * sizeof(lm_v3) >= LM_STREAM_MIN;
+
+		for ( ; i + 4 <= num; i += 4) {
+			r0 = xform_v3(&x, w, (const lm_float*)s);
+			s += src_stride;
+			r1 = xform_v3(&x, w, (const lm_float*)s);
+			s += src_stride;
+			r2 = xform_v3(&x, w, (const lm_float*)s);
+			s += src_stride;
+			r3 = xform_v3(&x, w, (const lm_float*)s);
+			s += src_stride;
+
+			/* x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3 */
+			t = _mm_shuffle_ps(r0, r1, _MM_SHUFFLE(0, 0, 2, 2));
+			r0 = _mm_shuffle_ps(r0, t, _MM_SHUFFLE(2, 0, 1, 0));
+			r1 = _mm_shuffle_ps(r1, r2, _MM_SHUFFLE(1, 0, 2, 1));
+			t = _mm_shuffle_ps(r2, r3, _MM_SHUFFLE(0, 0, 2, 2));
+			r2 = _mm_shuffle_ps(t, r3, _MM_SHUFFLE(2, 1, 2, 0));
+
+			if (stream) {
+				_mm_stream_ps((lm_float*)d, r0);
+				_mm_stream_ps((lm_float*)d + 4, r1);
+				_mm_stream_ps((lm_float*)d + 8, r2);
+			} else {
+				_mm_store_ps((lm_float*)d, r0);
+				_mm_store_ps((lm_float*)d + 4, r1);
+				_mm_store_ps((lm_float*)d + 8, r2);
+			}
+			d += 4 * dest_stride;
+		}
+
+		if (stream)
+			_mm_sfence();
+	}
+
+	for ( ; i < num; ++i, d += dest_stride, s += src_stride)
+		store_v3((lm_float*)d, xform_v3(&x, w, (const lm_float*)s));
+}
+
+#else /* __SSE__ */
+
+void lm_m4_transform_v4_array(lm_m4 m, void *dest, size_t dest_stride,
+			const void *src, size_t src_stride, size_t num)
+{
+	uint8_t *d = dest;
+	const uint8_t *s = src;
+	lm_v4 v;
+	size_t i, j;
+
+	if (!dest_stride)
+		dest_stride = sizeof(lm_v4);
+	if (!src_stride)
+		src_stride = sizeof(lm_v4);
+
+	for (i = 0; i < num; ++i, d += dest_stride, s += src_stride) {
+		memcpy(v, s, sizeof(v));
+		for (j = 0; j < 4; ++j)
+			((lm_float*)d)[j] = lm_v4_dot(m[j], v);
+	}
+}
+
+static void transform_v3(lm_m4 m, void *dest, size_t dest_stride,
+			const void *src, size_t src_stride, size_t num,
+								bool point)
+{
+	uint8_t *d = dest;
+	const uint8_t *s = src;
+	lm_v3 v;
+	size_t i, j;
+
+	if (!dest_stride)
+		dest_stride = sizeof(lm_v3);
+	if (!src_stride)
+		src_stride = sizeof(lm_v3);
+
+	for (i = 0; i < num; ++i, d += dest_stride, s += src_stride) {
+		memcpy(v, s, sizeof(v));
+		for (j = 0; j < 3; ++j)
+			((lm_float*)d)[j] = lm_v3_dot(m[j], v) +
+							(point ? m[j][3] : 0);
+	}
+}
+
+#endif /* __SSE__ */
+
+/*
+ * Transform points
+ * The vectors are extended by w = 1 so the translation of \m is applied. The
+ * fourth row of \m is ignored, no perspective division is done.
+ */
+void lm_m4_transform_v3_array(lm_m4 m, void *dest, size_t dest_stride,
+			const void *src, size_t src_stride, size_t num)
+{
+	transform_v3(m, dest, dest_stride, src, src_stride, num, true);
+}
+
+/*
+ * Transform directions
+ * The vectors are extended by w = 0 so only the rotation and scaling of \m is
+ * applied. Use this for normals of rigid and uniformly scaled transformations.
+ */
+void lm_m4_transform_v3_dir_array(lm_m4 m, void *dest, size_t dest_stride,
+			const void *src, size_t src_stride, size_t num)
+{
+	transform_v3(m, dest, dest_stride, src, src_stride, num, false);
+}
@@ -106,7 +106,7 @@ int uconf_file_open(struct uconf_file *file, const cstr *path,
 	return 0;
 
 err:
-	free(file->name);
+	cstr_free(file->name);
 	file->name = NULL;
 	return ret;
 }
@@ -29,20 +29,15 @@ extern int yyparse(void*);
 
 static cstr *get_dir(const cstr *str)
 {
-	size_t len, last = 0;
+	ssize_t last;
 
-	if (!CSTR_LEN(str))
-		return cstr_dup(str);
-
-	for (len = 0; len < CSTR_LEN(str); ++len) {
-		if (str->buf[len] == '/')
-			last = len;
-	}
+	last = cstr_rchr(str, '/');
 
 	/* if result is root directory, we need to copy the trailing '/' */
-	if (!last && str->buf[0] == '/') {
+	if (!last)
 		return cstr_dup(CSTR("/"));
-	}
+	if (last < 0)
+		last = 0;
 
 	return cstr_dup(CSTR_B(last, CSTR_VOID(str)));
 }